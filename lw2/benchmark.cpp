@@ -0,0 +1,420 @@
+#include "src/BmpProcessor.h"
+#include "src/Platform.h"
+#include "src/WorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Замеры blur в памяти без чтения и записи файлов по матрице размеров изображения,
+// числа потоков и ядер, политик привязки и размеров плиток
+
+enum class OutputFormat
+{
+	Csv,
+	Json,
+};
+
+struct ImageSize
+{
+	uint32_t width;
+	uint32_t height;
+};
+
+struct BenchmarkConfig
+{
+	std::vector<ImageSize> sizes{ { 640, 480 }, { 1920, 1080 } };
+	std::vector<int> threads;
+	std::vector<int> cores;
+	std::vector<PinPolicy> pins{ PinPolicy::None };
+	// 0 - статическое деление на квадраты, иначе work stealing с плитками этого размера
+	std::vector<int> tiles{ 0 };
+	int warmup = 1;
+	int repetitions = 5;
+	SimdLevel simdLevel = SimdBlur::DetectLevel();
+	OutputFormat format = OutputFormat::Csv;
+	std::string outputFile;
+};
+
+struct BenchmarkResult
+{
+	ImageSize size;
+	int threads;
+	int cores;
+	PinPolicy pin;
+	int tile;
+	double medianMs;
+	double p95Ms;
+	double minMs;
+	double megapixelsPerSecond;
+	double efficiency;
+};
+
+const char* PinName(PinPolicy policy)
+{
+	switch (policy)
+	{
+	case PinPolicy::Compact:
+		return "compact";
+	case PinPolicy::Scatter:
+		return "scatter";
+	default:
+		return "none";
+	}
+}
+
+std::vector<std::string> SplitList(const std::string& list)
+{
+	std::vector<std::string> items;
+	size_t position = 0;
+	while (position <= list.size())
+	{
+		size_t end = std::min(list.find(',', position), list.size());
+		items.push_back(list.substr(position, end - position));
+		position = end + 1;
+	}
+	return items;
+}
+
+std::vector<int> ParseInts(const std::string& list)
+{
+	std::vector<int> values;
+	for (const std::string& item : SplitList(list))
+	{
+		values.push_back(std::atoi(item.c_str()));
+	}
+	return values;
+}
+
+bool ParseOption(const std::string& option, BenchmarkConfig& config)
+{
+	auto value = [&](const char* prefix) { return option.substr(std::strlen(prefix)); };
+
+	if (option.starts_with("--sizes="))
+	{
+		config.sizes.clear();
+		for (const std::string& item : SplitList(value("--sizes=")))
+		{
+			size_t separator = item.find('x');
+			if (separator == std::string::npos)
+			{
+				return false;
+			}
+			int width = std::atoi(item.substr(0, separator).c_str());
+			int height = std::atoi(item.substr(separator + 1).c_str());
+			if (width <= 0 || height <= 0)
+			{
+				return false;
+			}
+			config.sizes.push_back({ static_cast<uint32_t>(width), static_cast<uint32_t>(height) });
+		}
+	}
+	else if (option.starts_with("--threads="))
+	{
+		config.threads = ParseInts(value("--threads="));
+	}
+	else if (option.starts_with("--cores="))
+	{
+		config.cores = ParseInts(value("--cores="));
+	}
+	else if (option.starts_with("--pin="))
+	{
+		config.pins.clear();
+		for (const std::string& item : SplitList(value("--pin=")))
+		{
+			if (item == "none")
+			{
+				config.pins.push_back(PinPolicy::None);
+			}
+			else if (item == "compact")
+			{
+				config.pins.push_back(PinPolicy::Compact);
+			}
+			else if (item == "scatter")
+			{
+				config.pins.push_back(PinPolicy::Scatter);
+			}
+			else
+			{
+				return false;
+			}
+		}
+	}
+	else if (option.starts_with("--tiles="))
+	{
+		config.tiles = ParseInts(value("--tiles="));
+	}
+	else if (option.starts_with("--warmup="))
+	{
+		config.warmup = std::atoi(value("--warmup=").c_str());
+	}
+	else if (option.starts_with("--reps="))
+	{
+		config.repetitions = std::atoi(value("--reps=").c_str());
+	}
+	else if (option == "--simd=scalar")
+	{
+		config.simdLevel = SimdLevel::Scalar;
+	}
+	else if (option == "--simd=sse2" && SimdBlur::DetectLevel() >= SimdLevel::Sse2)
+	{
+		config.simdLevel = SimdLevel::Sse2;
+	}
+	else if (option == "--simd=avx2" && SimdBlur::DetectLevel() >= SimdLevel::Avx2)
+	{
+		config.simdLevel = SimdLevel::Avx2;
+	}
+	else if (option == "--format=csv")
+	{
+		config.format = OutputFormat::Csv;
+	}
+	else if (option == "--format=json")
+	{
+		config.format = OutputFormat::Json;
+	}
+	else if (option.starts_with("--output="))
+	{
+		config.outputFile = value("--output=");
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+bool ParseCommandLine(int argc, char* argv[], BenchmarkConfig& config, int availableCpus)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!ParseOption(argv[i], config))
+		{
+			std::cerr << "Usage: " << argv[0]
+					  << " [--sizes=WxH,...] [--threads=N,...] [--cores=N,...] [--pin=none|compact|scatter,...]"
+					  << " [--tiles=N,...] [--warmup=N] [--reps=N] [--simd=scalar|sse2|avx2]"
+					  << " [--format=csv|json] [--output=file]\n"
+					  << "Tile 0 is the static scheduler, other sizes use work stealing\n";
+			return false;
+		}
+	}
+
+	// По умолчанию потоки удваиваются до числа доступных CPU, а ядра - все доступные
+	if (config.threads.empty())
+	{
+		for (int threads = 1; threads < availableCpus; threads *= 2)
+		{
+			config.threads.push_back(threads);
+		}
+		config.threads.push_back(availableCpus);
+	}
+	if (config.cores.empty())
+	{
+		config.cores.push_back(availableCpus);
+	}
+
+	bool valid = config.warmup >= 0 && config.repetitions >= 1
+		&& std::ranges::all_of(config.threads, [](int threads) { return threads >= 1; })
+		&& std::ranges::all_of(config.cores, [&](int cores) { return cores >= 1 && cores <= availableCpus; })
+		&& std::ranges::all_of(config.tiles, [](int tile) { return tile >= 0; });
+	if (!valid)
+	{
+		std::cerr << "Invalid parameters: threads and reps must be positive, cores in [1," << availableCpus
+				  << "], tiles and warmup not negative\n";
+	}
+	return valid;
+}
+
+// Шум с фиксированным зерном, чтобы прогоны были сравнимы между запусками
+FileData MakeSyntheticImage(ImageSize size)
+{
+	FileData data;
+	data.bitmapHeader.width = static_cast<int32_t>(size.width);
+	data.bitmapHeader.height = static_cast<int32_t>(size.height);
+	data.pixels.resize(static_cast<size_t>(data.GetRowStride()) * size.height);
+
+	std::mt19937 random(12345);
+	std::uniform_int_distribution<int> distribution(0, 255);
+	for (uint8_t& byte : data.pixels)
+	{
+		byte = static_cast<uint8_t>(distribution(random));
+	}
+	return data;
+}
+
+// Ближайший ранг: наименьшее значение, не меньшее доли percent выборки
+double Percentile(std::vector<double> samples, double percent)
+{
+	std::ranges::sort(samples);
+	size_t rank = static_cast<size_t>(std::ceil(percent / 100.0 * samples.size()));
+	return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+}
+
+// Первые cores CPU в порядке политики среди исходно разрешённых процессу
+std::vector<int> SelectCpus(const std::vector<int>& allowed, int cores, PinPolicy policy)
+{
+	std::vector<int> cpus;
+	for (int id : CpuTopology::Get().Order(policy))
+	{
+		if (std::ranges::find(allowed, id) != allowed.end() && static_cast<int>(cpus.size()) < cores)
+		{
+			cpus.push_back(id);
+		}
+	}
+	return cpus;
+}
+
+// Пул создаётся до замеров, поэтому в время попадает только blur, без запуска потоков
+BenchmarkResult Measure(const FileData& source, const BenchmarkConfig& config, int threads, int cores, PinPolicy pin, int tile)
+{
+	BlurOptions options;
+	options.simdLevel = config.simdLevel;
+	options.pinPolicy = pin;
+	options.scheduler = tile > 0 ? SchedulerType::WorkStealing : SchedulerType::Static;
+	options.tileSize = tile > 0 ? tile : options.tileSize;
+
+	WorkerPool pool(threads, pin);
+	FileData image = source;
+	std::vector<double> samples;
+	for (int run = 0; run < config.warmup + config.repetitions; ++run)
+	{
+		std::ranges::copy(source.pixels, image.pixels.begin());
+		auto start = std::chrono::steady_clock::now();
+		BmpProcessor::BlurImage(image, pool, options);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (run >= config.warmup)
+		{
+			samples.push_back(ms);
+		}
+	}
+
+	BenchmarkResult result{};
+	result.size = { source.GetWidth(), source.GetHeight() };
+	result.threads = threads;
+	result.cores = cores;
+	result.pin = pin;
+	result.tile = tile;
+	result.medianMs = Percentile(samples, 50);
+	result.p95Ms = Percentile(samples, 95);
+	result.minMs = *std::ranges::min_element(samples);
+	result.megapixelsPerSecond = static_cast<double>(result.size.width) * result.size.height / (result.medianMs * 1000.0);
+	return result;
+}
+
+// Эффективность - ускорение относительно наименьшего числа потоков той же конфигурации,
+// делённое на отношение числа потоков: 1 - идеальное масштабирование
+void ComputeEfficiency(std::vector<BenchmarkResult>& results)
+{
+	for (BenchmarkResult& result : results)
+	{
+		const BenchmarkResult* base = &result;
+		for (const BenchmarkResult& other : results)
+		{
+			bool sameConfig = other.size.width == result.size.width && other.size.height == result.size.height
+				&& other.cores == result.cores && other.pin == result.pin && other.tile == result.tile;
+			if (sameConfig && other.threads < base->threads)
+			{
+				base = &other;
+			}
+		}
+		result.efficiency = base->medianMs * base->threads / (result.medianMs * result.threads);
+	}
+}
+
+void WriteCsv(std::ostream& out, const std::vector<BenchmarkResult>& results, const BenchmarkConfig& config)
+{
+	out << "width,height,threads,cores,pin,tile,reps,median_ms,p95_ms,min_ms,mpixels_per_s,efficiency\n";
+	for (const BenchmarkResult& result : results)
+	{
+		out << result.size.width << "," << result.size.height << "," << result.threads << "," << result.cores << ","
+			<< PinName(result.pin) << "," << result.tile << "," << config.repetitions << "," << result.medianMs << ","
+			<< result.p95Ms << "," << result.minMs << "," << result.megapixelsPerSecond << "," << result.efficiency << "\n";
+	}
+}
+
+void WriteJson(std::ostream& out, const std::vector<BenchmarkResult>& results, const BenchmarkConfig& config)
+{
+	const CpuTopology& topology = CpuTopology::Get();
+	out << "{\n  \"iterations\": " << BmpProcessor::ITERATIONS << ",\n  \"cpus\": " << topology.GetCpus().size()
+		<< ",\n  \"physical_cores\": " << topology.GetCoreCount() << ",\n  \"numa_nodes\": " << topology.GetNodeCount()
+		<< ",\n  \"warmup\": " << config.warmup << ",\n  \"reps\": " << config.repetitions << ",\n  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const BenchmarkResult& result = results[i];
+		out << "    {\"width\": " << result.size.width << ", \"height\": " << result.size.height
+			<< ", \"threads\": " << result.threads << ", \"cores\": " << result.cores << ", \"pin\": \""
+			<< PinName(result.pin) << "\", \"tile\": " << result.tile << ", \"median_ms\": " << result.medianMs
+			<< ", \"p95_ms\": " << result.p95Ms << ", \"min_ms\": " << result.minMs
+			<< ", \"mpixels_per_s\": " << result.megapixelsPerSecond << ", \"efficiency\": " << result.efficiency << "}"
+			<< (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<int> allowed = Platform::GetProcessCpus();
+	BenchmarkConfig config;
+	if (!ParseCommandLine(argc, argv, config, static_cast<int>(allowed.size())))
+	{
+		return 1;
+	}
+
+	// Файл открывается до замеров, чтобы неверный путь не выбросил результаты всего прогона
+	std::ofstream file;
+	if (!config.outputFile.empty())
+	{
+		file.open(config.outputFile);
+		if (!file)
+		{
+			std::cerr << "Cannot open output file\n";
+			return 1;
+		}
+	}
+
+	std::vector<BenchmarkResult> results;
+	for (ImageSize size : config.sizes)
+	{
+		FileData source = MakeSyntheticImage(size);
+		for (int cores : config.cores)
+		{
+			for (PinPolicy pin : config.pins)
+			{
+				if (!Platform::SetProcessCpus(SelectCpus(allowed, cores, pin)))
+				{
+					std::cerr << "Failed to set CPU affinity\n";
+					return 1;
+				}
+				for (int tile : config.tiles)
+				{
+					for (int threads : config.threads)
+					{
+						// Прогресс идёт в stderr, чтобы stdout оставался чистым CSV/JSON
+						std::cerr << size.width << "x" << size.height << " threads " << threads << " cores " << cores
+								  << " pin " << PinName(pin) << " tile " << tile << "\n";
+						results.push_back(Measure(source, config, threads, cores, pin, tile));
+					}
+				}
+			}
+		}
+	}
+	Platform::SetProcessCpus(allowed);
+	ComputeEfficiency(results);
+
+	std::ostream& out = config.outputFile.empty() ? std::cout : file;
+	if (config.format == OutputFormat::Json)
+	{
+		WriteJson(out, results, config);
+	}
+	else
+	{
+		WriteCsv(out, results, config);
+	}
+
+	return 0;
+}
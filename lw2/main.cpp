@@ -1,25 +1,408 @@
+#include "src/BatchProcessor.h"
 #include "src/BmpProcessor.h"
+#include "src/Convolution.h"
+#include "src/FrameStream.h"
+#include "src/IncrementalBlur.h"
+#include "src/MappedBmp.h"
+#include "src/PlanarImage.h"
+#include "src/Platform.h"
+#include "src/ProgressiveBlur.h"
+#include "src/SeparableBlur.h"
+#include "src/StreamingBlur.h"
+#include "src/TemporalBlur.h"
+#include "src/TileAutotuner.h"
 
 #include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <functional>
 #include <iostream>
 #include <numeric>
 #include <random>
 #include <vector>
-#include <windows.h>
+
+enum class BlurMode
+{
+	Iterative,
+	Separable,
+	Temporal,
+	Compare,
+	Filter,
+};
+
+enum class FilterType
+{
+	Box,
+	Gaussian,
+	Unsharp,
+	Custom,
+};
 
 struct InputData
 {
 	std::string inputFile, outputFile;
 	int numCores, numThreads;
+	BlurMode mode = BlurMode::Iterative;
+	BlurOptions blurOptions;
+	bool useMmap = false;
+	size_t streamBudgetMb = 0;
+	bool batch = false;
+	FilterType filter = FilterType::Gaussian;
+	int kernelSize = 3;
+	float amount = 1.0f;
+	std::vector<int> kernelWeights;
+	bool autotune = false;
+	std::string tilingCache = "lw2_tiling.cache";
+	// Прошлый вход и его результат для инкрементального blur одного файла
+	std::string previousInput, previousOutput;
+	bool frames = false;
+	int frameStart = 0;
+	int frameWorkers = 1;
+	// Высота полос прогрессивного вывода, 0 - результат пишется целиком в конце
+	int progressiveRows = 0;
 };
 
+// Веса через запятую: size весов - сепарабельное ядро, size * size - полное
+std::vector<int> ParseWeights(const std::string& list)
+{
+	std::vector<int> weights;
+	size_t position = 0;
+	while (position <= list.size())
+	{
+		size_t end = std::min(list.find(',', position), list.size());
+		weights.push_back(std::atoi(list.substr(position, end - position).c_str()));
+		position = end + 1;
+	}
+	return weights;
+}
+
+bool ParseOption(const std::string& option, InputData& input)
+{
+	if (option == "--mode=iterative")
+	{
+		input.mode = BlurMode::Iterative;
+	}
+	else if (option == "--mode=separable")
+	{
+		input.mode = BlurMode::Separable;
+	}
+	else if (option == "--mode=temporal")
+	{
+		input.mode = BlurMode::Temporal;
+	}
+	else if (option == "--mode=compare")
+	{
+		input.mode = BlurMode::Compare;
+	}
+	else if (option.starts_with("--radius="))
+	{
+		input.blurOptions.radius = std::atoi(option.c_str() + std::strlen("--radius="));
+	}
+	else if (option == "--simd=scalar")
+	{
+		input.blurOptions.simdLevel = SimdLevel::Scalar;
+	}
+	else if (option == "--simd=sse2" && SimdBlur::DetectLevel() >= SimdLevel::Sse2)
+	{
+		input.blurOptions.simdLevel = SimdLevel::Sse2;
+	}
+	else if (option == "--simd=avx2" && SimdBlur::DetectLevel() >= SimdLevel::Avx2)
+	{
+		input.blurOptions.simdLevel = SimdLevel::Avx2;
+	}
+	else if (option == "--scheduler=static")
+	{
+		input.blurOptions.scheduler = SchedulerType::Static;
+	}
+	else if (option == "--scheduler=stealing")
+	{
+		input.blurOptions.scheduler = SchedulerType::WorkStealing;
+	}
+	else if (option.starts_with("--tile="))
+	{
+		input.blurOptions.tileSize = std::atoi(option.c_str() + std::strlen("--tile="));
+	}
+	else if (option == "--tiling=squares")
+	{
+		input.blurOptions.tileShape = TileShape::Squares;
+	}
+	else if (option == "--tiling=strips")
+	{
+		input.blurOptions.tileShape = TileShape::Strips;
+	}
+	else if (option == "--tiling=morton")
+	{
+		input.blurOptions.tileShape = TileShape::Morton;
+	}
+	else if (option == "--autotune")
+	{
+		input.autotune = true;
+	}
+	else if (option.starts_with("--autotune="))
+	{
+		input.autotune = true;
+		input.tilingCache = option.substr(std::strlen("--autotune="));
+	}
+	else if (option == "--incremental")
+	{
+		input.blurOptions.incremental = true;
+	}
+	else if (option.starts_with("--incremental="))
+	{
+		std::string files = option.substr(std::strlen("--incremental="));
+		size_t comma = files.find(',');
+		if (comma == std::string::npos)
+		{
+			std::cerr << "Incremental blur expects <previous_input.bmp>,<previous_output.bmp>\n";
+			return false;
+		}
+		input.blurOptions.incremental = true;
+		input.previousInput = files.substr(0, comma);
+		input.previousOutput = files.substr(comma + 1);
+	}
+	else if (option.starts_with("--depth="))
+	{
+		input.blurOptions.temporalDepth = std::atoi(option.c_str() + std::strlen("--depth="));
+	}
+	else if (option == "--mmap")
+	{
+		input.useMmap = true;
+	}
+	else if (option == "--batch")
+	{
+		input.batch = true;
+	}
+	else if (option == "--frames")
+	{
+		input.frames = true;
+	}
+	else if (option == "--progressive")
+	{
+		input.progressiveRows = ProgressiveBlur::DEFAULT_BAND_ROWS;
+	}
+	else if (option.starts_with("--progressive="))
+	{
+		input.progressiveRows = std::atoi(option.c_str() + std::strlen("--progressive="));
+		if (input.progressiveRows < 1)
+		{
+			std::cerr << "Invalid band height for progressive output: must be positive\n";
+			return false;
+		}
+	}
+	else if (option.starts_with("--frame-start="))
+	{
+		input.frameStart = std::atoi(option.c_str() + std::strlen("--frame-start="));
+	}
+	else if (option.starts_with("--frame-workers="))
+	{
+		input.frameWorkers = std::atoi(option.c_str() + std::strlen("--frame-workers="));
+	}
+	else if (option == "--pin=none")
+	{
+		input.blurOptions.pinPolicy = PinPolicy::None;
+	}
+	else if (option == "--pin=compact")
+	{
+		input.blurOptions.pinPolicy = PinPolicy::Compact;
+	}
+	else if (option == "--pin=scatter")
+	{
+		input.blurOptions.pinPolicy = PinPolicy::Scatter;
+	}
+	else if (option == "--filter=box")
+	{
+		input.mode = BlurMode::Filter;
+		input.filter = FilterType::Box;
+	}
+	else if (option == "--filter=gaussian")
+	{
+		input.mode = BlurMode::Filter;
+		input.filter = FilterType::Gaussian;
+	}
+	else if (option == "--filter=unsharp")
+	{
+		input.mode = BlurMode::Filter;
+		input.filter = FilterType::Unsharp;
+	}
+	else if (option.starts_with("--kernel="))
+	{
+		input.mode = BlurMode::Filter;
+		input.filter = FilterType::Custom;
+		input.kernelWeights = ParseWeights(option.substr(std::strlen("--kernel=")));
+	}
+	else if (option.starts_with("--kernel-size="))
+	{
+		input.kernelSize = std::atoi(option.c_str() + std::strlen("--kernel-size="));
+	}
+	else if (option.starts_with("--amount="))
+	{
+		input.amount = static_cast<float>(std::atof(option.c_str() + std::strlen("--amount=")));
+	}
+	else if (option == "--layout=interleaved")
+	{
+		input.blurOptions.layout = PixelLayout::Interleaved;
+	}
+	else if (option == "--layout=planar")
+	{
+		input.blurOptions.layout = PixelLayout::Planar;
+	}
+	else if (option == "--first-touch")
+	{
+		input.blurOptions.firstTouch = true;
+	}
+	else if (option.starts_with("--roi="))
+	{
+		// x0,y0,x1,y1[:priority], координаты сверху вниз, правая и нижняя граница не включаются
+		std::string region = option.substr(std::strlen("--roi="));
+		size_t colon = region.find(':');
+		std::vector<int> bounds = ParseWeights(region.substr(0, colon));
+		int priority = colon == std::string::npos ? 1 : std::atoi(region.c_str() + colon + 1);
+		if (bounds.size() != 4 || bounds[0] < 0 || bounds[1] < 0 || bounds[0] >= bounds[2] || bounds[1] >= bounds[3] || priority < 1)
+		{
+			std::cerr << "Invalid region of interest: expected --roi=x0,y0,x1,y1[:priority] with x0 < x1, y0 < y1\n";
+			return false;
+		}
+		input.blurOptions.regionsOfInterest.push_back({ { bounds[0], bounds[1], bounds[2], bounds[3] }, priority });
+	}
+	else if (option.starts_with("--stream="))
+	{
+		input.streamBudgetMb = std::strtoull(option.c_str() + std::strlen("--stream="), nullptr, 10);
+	}
+	else
+	{
+		std::cerr << "Unknown option: " << option << "\n";
+		return false;
+	}
+
+	if (input.blurOptions.tileSize < 1 || input.blurOptions.temporalDepth < 1)
+	{
+		std::cerr << "Invalid tile size or depth: must be positive\n";
+		return false;
+	}
+	return true;
+}
+
+// Сочетания опций проверяются, когда разобраны все, чтобы результат не зависел от их порядка
+bool ValidateOptions(const InputData& input)
+{
+	if ((input.useMmap || input.streamBudgetMb > 0 || input.batch) && input.mode != BlurMode::Iterative)
+	{
+		std::cerr << "Memory-mapped, streaming and batch processing are supported only in iterative mode\n";
+		return false;
+	}
+
+	if (input.batch && (input.useMmap || input.streamBudgetMb > 0))
+	{
+		std::cerr << "Batch mode cannot be combined with --mmap or --stream\n";
+		return false;
+	}
+
+	if (input.streamBudgetMb > 0 && (input.useMmap || input.blurOptions.radius != 1))
+	{
+		std::cerr << "Streaming blur works only with radius 1 and without --mmap\n";
+		return false;
+	}
+
+	if (input.blurOptions.layout == PixelLayout::Planar
+		&& (input.mode != BlurMode::Iterative || input.blurOptions.radius != 1
+			|| input.useMmap || input.streamBudgetMb > 0 || input.blurOptions.firstTouch))
+	{
+		std::cerr << "Planar layout is supported only in iterative mode with radius 1, without --mmap, --stream and --first-touch\n";
+		return false;
+	}
+
+	if ((input.autotune || input.blurOptions.tileShape != TileShape::Squares)
+		&& (input.blurOptions.scheduler != SchedulerType::Static || input.blurOptions.firstTouch))
+	{
+		std::cerr << "Tiling and autotuning apply only to the static scheduler without --first-touch\n";
+		return false;
+	}
+
+	if (input.autotune && (input.mode != BlurMode::Iterative || input.blurOptions.layout != PixelLayout::Interleaved
+		|| input.useMmap || input.streamBudgetMb > 0 || input.batch))
+	{
+		std::cerr << "Autotuning is supported only in iterative mode with interleaved layout, without --mmap, --stream and --batch\n";
+		return false;
+	}
+
+	if (input.blurOptions.incremental
+		&& (input.mode != BlurMode::Iterative || input.blurOptions.layout != PixelLayout::Interleaved || input.autotune
+			|| input.useMmap || input.streamBudgetMb > 0 || input.blurOptions.firstTouch))
+	{
+		std::cerr << "Incremental blur is supported only in iterative mode with interleaved layout,"
+				  << " without --autotune, --mmap, --stream and --first-touch\n";
+		return false;
+	}
+
+	if (input.blurOptions.incremental && input.batch != input.previousInput.empty())
+	{
+		std::cerr << "Use --incremental=<previous_input.bmp>,<previous_output.bmp> for one file and --incremental with --batch\n";
+		return false;
+	}
+
+	if (input.frames
+		&& (input.mode != BlurMode::Iterative || input.blurOptions.layout != PixelLayout::Interleaved || input.batch
+			|| input.useMmap || input.streamBudgetMb > 0 || input.autotune || input.blurOptions.incremental
+			|| input.blurOptions.firstTouch))
+	{
+		std::cerr << "Frame streaming is supported only in iterative mode with interleaved layout,"
+				  << " without --batch, --mmap, --stream, --autotune, --incremental and --first-touch\n";
+		return false;
+	}
+
+	if (input.progressiveRows > 0
+		&& (input.mode != BlurMode::Iterative || input.blurOptions.layout != PixelLayout::Interleaved || input.batch
+			|| input.frames || input.useMmap || input.streamBudgetMb > 0 || input.autotune || input.blurOptions.incremental
+			|| input.blurOptions.firstTouch))
+	{
+		std::cerr << "Progressive output is supported only in iterative mode with interleaved layout,"
+				  << " without --batch, --frames, --mmap, --stream, --autotune, --incremental and --first-touch\n";
+		return false;
+	}
+
+	// Остальные режимы не используют планировщик плиток и порядок плиток в них не меняется
+	if (!input.blurOptions.regionsOfInterest.empty()
+		&& (input.mode != BlurMode::Iterative || input.blurOptions.layout != PixelLayout::Interleaved
+			|| input.streamBudgetMb > 0 || input.blurOptions.incremental || input.progressiveRows > 0))
+	{
+		std::cerr << "Regions of interest are supported only in iterative mode with interleaved layout,"
+				  << " without --stream, --incremental and --progressive\n";
+		return false;
+	}
+
+	if (input.blurOptions.firstTouch && input.blurOptions.pinPolicy == PinPolicy::None)
+	{
+		std::cerr << "First-touch allocation requires --pin=compact or --pin=scatter\n";
+		return false;
+	}
+
+	if (input.frameStart < 0 || input.frameWorkers < 1)
+	{
+		std::cerr << "Invalid frame start or frame workers: start must not be negative, workers must be positive\n";
+		return false;
+	}
+	return true;
+}
+
 bool ParseCommandLine(int argc, char* argv[], InputData& input)
 {
-	if (argc != 5)
+	if (argc < 5)
 	{
-		std::cerr << "Usage: " << argv[0] << " <input.bmp> <output.bmp> <num_threads> <num_cores>\n";
+		std::cerr << "Usage: " << argv[0] << " <input.bmp> <output.bmp> <num_threads> <num_cores>"
+				  << " [--mode=iterative|separable|temporal|compare] [--radius=N]"
+				  << " [--simd=scalar|sse2|avx2] [--scheduler=static|stealing] [--tile=N] [--depth=N] [--mmap] [--stream=MB]"
+				  << " [--tiling=squares|strips|morton] [--autotune[=cache_file]]"
+				  << " [--incremental[=previous_input.bmp,previous_output.bmp]]"
+				  << " [--frames] [--frame-start=N] [--frame-workers=N] [--progressive[=rows]]"
+				  << " [--batch] [--pin=none|compact|scatter] [--first-touch]"
+				  << " [--layout=interleaved|planar] [--roi=x0,y0,x1,y1[:priority] ...]"
+				  << " [--filter=box|gaussian|unsharp] [--kernel=w1,w2,...] [--kernel-size=N] [--amount=F]\n"
+				  << "With --batch <input.bmp> is a directory or a list file and <output.bmp> is an output directory\n"
+				  << "Incremental blur recomputes only tiles changed since the previous image of the batch"
+				  << " or since the given previous input\n"
+				  << "With --frames <input.bmp> and <output.bmp> are numbered patterns like frame_%04d.bmp,"
+				  << " the input may be - to read BMP frames from stdin\n"
+				  << "With --progressive finished bands are written into <output.bmp> from the top of the image as soon as they are final\n";
 		return false;
 	}
 	input.inputFile = argv[1];
@@ -27,44 +410,183 @@ bool ParseCommandLine(int argc, char* argv[], InputData& input)
 	input.numCores = std::atoi(argv[3]);
 	input.numThreads = std::atoi(argv[4]);
 
-	if (input.numThreads < 1 || input.numThreads > 16 || input.numCores < 1 || input.numCores > 4)
+	for (int i = 5; i < argc; ++i)
 	{
-		std::cerr << "Invalid parameters: threads in [1,16], cores in [1,4]\n";
+		if (!ParseOption(argv[i], input))
+		{
+			return false;
+		}
+	}
+
+	int cpuCount = static_cast<int>(Platform::GetProcessCpus().size());
+	if (input.numThreads < 1 || input.numCores < 1 || input.numCores > cpuCount)
+	{
+		std::cerr << "Invalid parameters: threads must be positive, cores in [1," << cpuCount << "]\n";
 		return false;
 	}
-	return true;
+
+	// Сепарабельное ядро построено только для 3x3
+	if (input.blurOptions.radius < 1 || (input.blurOptions.radius != 1 && input.mode != BlurMode::Iterative))
+	{
+		std::cerr << "Invalid radius: must be positive, values above 1 only for iterative mode\n";
+		return false;
+	}
+	return ValidateOptions(input);
 }
 
-bool SetCpuAffinity(int coresAmount)
+// Процессу оставляются первые coresAmount из уже разрешённых ему логических CPU (cpuset, taskset)
+// в порядке политики привязки, без привязки - в порядке номеров
+bool SetCpuAffinity(int coresAmount, PinPolicy policy)
 {
-	DWORD_PTR mask = (1ULL << coresAmount) - 1;
-	return SetProcessAffinityMask(GetCurrentProcess(), mask) != 0;
+	std::vector<int> allowed = Platform::GetProcessCpus();
+	std::vector<int> cpus;
+	for (int id : CpuTopology::Get().Order(policy))
+	{
+		if (std::ranges::find(allowed, id) != allowed.end() && static_cast<int>(cpus.size()) < coresAmount)
+		{
+			cpus.push_back(id);
+		}
+	}
+	return static_cast<int>(cpus.size()) == coresAmount && Platform::SetProcessCpus(cpus);
 }
 
-std::vector<std::vector<Square>> DivideIntoSquares(uint32_t width, uint32_t height, int numThreads);
-void ApplyBoxBlurToSquare(const std::vector<uint8_t>& src, std::vector<uint8_t>& dst,
-	const Square& square, uint32_t width, uint32_t height, uint32_t rowStride);
-DWORD WINAPI ThreadProc(LPVOID lpParam);
+void PrintTopology(const InputData& input)
+{
+	const CpuTopology& topology = CpuTopology::Get();
+	std::cout << "Topology: " << topology.GetCpus().size() << " CPUs, " << topology.GetCoreCount() << " cores, "
+			  << topology.GetNodeCount() << " NUMA nodes\n";
 
-int main(int argc, char* argv[])
+	std::vector<int> plan = Platform::PlanThreadCpus(input.blurOptions.pinPolicy);
+	if (!plan.empty())
+	{
+		std::cout << "Thread CPUs:";
+		for (int i = 0; i < input.numThreads; ++i)
+		{
+			std::cout << " " << plan[i % plan.size()];
+		}
+		std::cout << "\n";
+	}
+}
+
+double MeasureMs(const std::function<void()>& func)
 {
-	LARGE_INTEGER freq, start, end;
-	QueryPerformanceFrequency(&freq);
-	QueryPerformanceCounter(&start);
+	auto start = std::chrono::steady_clock::now();
+	func();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
 
-	InputData input;
+// Раньше каждая итерация создавала все потоки заново и дважды копировала изображение
+void PrintBlurStats(const BlurStats& stats, int numThreads)
+{
+	int removedCopies = 2 * stats.iterations - stats.bufferCopies;
+	std::cout << "Thread creation: " << stats.threadStartMs << " ms for " << numThreads << " threads, once instead of "
+			  << stats.iterations << " times (~" << stats.threadStartMs * (stats.iterations - 1) << " ms removed)\n";
+	if (stats.bufferCopies > 0)
+	{
+		std::cout << "Buffer copy: " << stats.bufferCopyMs << " ms, " << stats.bufferCopies << " copy instead of "
+				  << 2 * stats.iterations << " (~" << stats.bufferCopyMs / stats.bufferCopies * removedCopies << " ms removed)\n";
+	}
+	else
+	{
+		std::cout << "Buffer copy: none instead of " << 2 * stats.iterations << "\n";
+	}
 
-	if (!ParseCommandLine(argc, argv, input))
+	for (size_t i = 0; i < stats.workers.size(); ++i)
 	{
-		return 1;
+		std::cout << "Thread " << i + 1 << ": tiles executed " << stats.workers[i].executed
+				  << ", stolen " << stats.workers[i].stolen << "\n";
 	}
 
-	if (!SetCpuAffinity(input.numCores))
+	if (stats.roiCompleteMs > 0)
 	{
-		std::cerr << "Failed to set CPU affinity\n";
-		return 1;
+		std::cout << "Regions of interest complete: " << stats.roiCompleteMs << " ms, full image: "
+				  << stats.fullCompleteMs << " ms\n";
 	}
+}
+
+void PrintDiff(const std::string& name, double time, const ImageDiff& diff)
+{
+	std::cout << name << " blur: " << time << " ms, max channel diff: " << diff.maxDiff
+			  << ", mean diff: " << diff.meanDiff << ", different bytes: " << diff.differentBytes << "\n";
+}
+
+// Сравнивает остальные режимы с итеративным, результатом остаётся итеративный
+void CompareBlurModes(FileData& fileData, int numThreads, const BlurOptions& options)
+{
+	FileData separable = fileData;
+	FileData temporal = fileData;
+	FileData planar = fileData;
+
+	double iterativeTime = MeasureMs([&] { BmpProcessor::BlurImage(fileData, numThreads, options); });
+	double separableTime = MeasureMs([&] { SeparableBlur::BlurImage(separable, numThreads, options); });
+	double temporalTime = MeasureMs([&] { TemporalBlur::BlurImage(temporal, numThreads, options); });
+	double planarTime = MeasureMs([&] { PlanarBlur::BlurImage(planar, numThreads, options); });
+
+	std::cout << "Iterative blur: " << iterativeTime << " ms\n";
+	PrintDiff("Separable", separableTime, SeparableBlur::Compare(fileData, separable));
+	PrintDiff("Temporal", temporalTime, SeparableBlur::Compare(fileData, temporal));
+	PrintDiff("Planar", planarTime, SeparableBlur::Compare(fileData, planar));
+}
+
+// Однократная свёртка вместо итеративного blur
+void ApplyFilter(FileData& fileData, const InputData& input)
+{
+	ConvolutionKernel kernel = input.filter == FilterType::Box ? ConvolutionKernel::Box(input.kernelSize)
+		: input.filter == FilterType::Custom ? ConvolutionKernel::Custom(input.kernelWeights)
+		: ConvolutionKernel::Gaussian(input.kernelSize);
+	float amount = input.filter == FilterType::Unsharp ? input.amount : 0.0f;
 
+	std::cout << "Filter: " << kernel.size << "x" << kernel.size << (kernel.separable ? " separable" : "")
+			  << " kernel, divisor " << kernel.divisor << "\n";
+	double time = MeasureMs([&] {
+		ConvolutionFilter::Apply(fileData, input.numThreads, kernel, amount, input.blurOptions);
+	});
+	std::cout << "Filter time: " << time << " ms\n";
+}
+
+// Разбиение берётся из кэша автотюнера или подбирается пробными прогонами на том же пуле
+BlurStats BlurAutotuned(FileData& fileData, const InputData& input)
+{
+	WorkerPool pool(input.numThreads, input.blurOptions.pinPolicy);
+	BlurOptions options = input.blurOptions;
+	TileChoice choice{};
+	double time = MeasureMs([&] {
+		choice = TileAutotuner::Choose(fileData.GetWidth(), fileData.GetHeight(), pool, options, input.tilingCache);
+	});
+	options.tileShape = choice.shape;
+	options.tileSize = choice.tileSize;
+
+	std::cout << "Tiling: " << TileAutotuner::ShapeName(choice.shape);
+	if (choice.shape == TileShape::Morton)
+	{
+		std::cout << " " << choice.tileSize << "x" << choice.tileSize;
+	}
+	if (choice.cached)
+	{
+		std::cout << ", cached\n";
+	}
+	else
+	{
+		std::cout << ", tuned in " << time << " ms\n";
+	}
+	return BmpProcessor::BlurImage(fileData, pool, options);
+}
+
+// Пересчитываются только плитки, отличающиеся от прошлого входа, остальное берётся из прошлого результата
+void BlurIncremental(FileData& fileData, const InputData& input)
+{
+	WorkerPool pool(input.numThreads, input.blurOptions.pinPolicy);
+	IncrementalBlur incremental(pool, input.blurOptions);
+	incremental.Seed(BmpProcessor::Read(input.previousInput), BmpProcessor::Read(input.previousOutput));
+	IncrementalStats stats = incremental.Blur(fileData);
+
+	std::cout << "Changed tiles: " << stats.dirtyTiles << " of " << stats.totalTiles << ", diff time: " << stats.diffMs << " ms\n";
+	std::cout << (stats.full ? "Full blur" : "Incremental blur") << ": recomputed " << stats.recomputedShare * 100.0
+			  << "% of pixels in " << stats.blurMs << " ms\n";
+}
+
+void ProcessFile(const InputData& input)
+{
 	FileData fileData = BmpProcessor::Read(input.inputFile);
 
 	std::cout << "Image size: " << fileData.GetWidth() << "x" << fileData.GetHeight() << "\n";
@@ -72,13 +594,183 @@ int main(int argc, char* argv[])
 	std::cout << "Pixels size: " << fileData.pixels.size() << "\n";
 	std::cout << "Threads: " << input.numThreads << ", Cores: " << input.numCores << "\n";
 
-	BmpProcessor::BlurImage(fileData, input.numThreads);
+	switch (input.mode)
+	{
+	case BlurMode::Iterative:
+		if (input.blurOptions.layout == PixelLayout::Planar)
+		{
+			PrintBlurStats(PlanarBlur::BlurImage(fileData, input.numThreads, input.blurOptions), input.numThreads);
+		}
+		else if (input.blurOptions.incremental)
+		{
+			BlurIncremental(fileData, input);
+		}
+		else if (input.autotune)
+		{
+			PrintBlurStats(BlurAutotuned(fileData, input), input.numThreads);
+		}
+		else
+		{
+			PrintBlurStats(BmpProcessor::BlurImage(fileData, input.numThreads, input.blurOptions), input.numThreads);
+		}
+		break;
+	case BlurMode::Separable:
+		SeparableBlur::BlurImage(fileData, input.numThreads, input.blurOptions);
+		break;
+	case BlurMode::Temporal:
+		TemporalBlur::BlurImage(fileData, input.numThreads, input.blurOptions);
+		break;
+	case BlurMode::Compare:
+		CompareBlurModes(fileData, input.numThreads, input.blurOptions);
+		break;
+	case BlurMode::Filter:
+		ApplyFilter(fileData, input);
+		break;
+	}
 
 	BmpProcessor::Write(input.outputFile, fileData);
 	std::cout << "Output saved to: " << input.outputFile << "\n";
+}
+
+// Готовые полосы сразу пишутся в выходной файл, начиная с верха картинки
+void ProcessProgressiveFile(const InputData& input)
+{
+	FileData fileData = BmpProcessor::Read(input.inputFile);
+	std::cout << "Image size: " << fileData.GetWidth() << "x" << fileData.GetHeight() << "\n";
+	std::cout << "Threads: " << input.numThreads << ", Cores: " << input.numCores << ", progressive output\n";
+
+	WorkerPool pool(input.numThreads, input.blurOptions.pinPolicy);
+	ProgressiveStats stats = ProgressiveBlur::BlurToFile(fileData, input.outputFile, pool, input.progressiveRows, input.blurOptions);
+
+	std::cout << "Bands: " << stats.bands << " of " << stats.bandRows << " rows, recomputed rows: x"
+			  << stats.recomputeFactor << "\n";
+	std::cout << "First band: " << stats.firstBandMs << " ms, full image: " << stats.totalMs << " ms\n";
+	std::cout << "Output saved to: " << input.outputFile << "\n";
+}
+
+// Пиксели читаются из отображённого файла и пишутся в отображённый выходной без промежуточных копий
+void ProcessMappedFile(const InputData& input)
+{
+	std::cout << "Threads: " << input.numThreads << ", Cores: " << input.numCores << ", memory-mapped\n";
+	PrintBlurStats(MappedBmp::BlurFile(input.inputFile, input.outputFile, input.numThreads, input.blurOptions), input.numThreads);
+	std::cout << "Output saved to: " << input.outputFile << "\n";
+}
+
+// Изображение обрабатывается полосами в пределах бюджета памяти
+void ProcessStreamingFile(const InputData& input)
+{
+	std::cout << "Threads: " << input.numThreads << ", Cores: " << input.numCores
+			  << ", streaming with " << input.streamBudgetMb << " MB budget\n";
+
+	StreamingStats stats = StreamingBlur::BlurFile(input.inputFile, input.outputFile, input.numThreads,
+		input.streamBudgetMb * 1024 * 1024, input.blurOptions.simdLevel, input.blurOptions.pinPolicy);
+
+	std::cout << "Bands: " << stats.bands << " of " << stats.bandRows << " rows, buffers: "
+			  << stats.bufferBytes / (1024.0 * 1024.0) << " MB\n";
+	std::cout << "Compute: " << stats.computeMs << " ms, write: " << stats.writeMs
+			  << " ms, waiting for read: " << stats.readWaitMs << " ms\n";
+	std::cout << "Output saved to: " << input.outputFile << "\n";
+}
+
+void PrintStage(const std::string& name, const StageStats& stage, double wallMs)
+{
+	std::cout << name << ": " << stage.items << " images, busy " << stage.busyMs << " ms, utilisation "
+			  << (wallMs > 0 ? stage.busyMs * 100.0 / wallMs : 0.0) << "%\n";
+}
+
+// Каталог или список файлов обрабатывается конвейером чтение - blur - запись
+void ProcessBatch(const InputData& input)
+{
+	auto inputs = BatchProcessor::CollectInputs(input.inputFile);
+	std::cout << "Batch: " << inputs.size() << " files, Threads: " << input.numThreads
+			  << ", Cores: " << input.numCores << "\n";
+
+	BatchStats stats = BatchProcessor::Run(inputs, input.outputFile, input.numThreads, input.blurOptions);
+
+	std::cout << "Processed " << stats.images << " images in " << stats.wallMs << " ms, "
+			  << (stats.wallMs > 0 ? stats.images * 1000.0 / stats.wallMs : 0.0) << " images/s\n";
+	PrintStage("Read", stats.read, stats.wallMs);
+	PrintStage("Blur", stats.blur, stats.wallMs);
+	PrintStage("Write", stats.write, stats.wallMs);
+	if (input.blurOptions.incremental)
+	{
+		std::cout << "Incremental: " << stats.incrementalImages << " of " << stats.images << " images\n";
+	}
+	std::cout << "Output saved to: " << input.outputFile << "\n";
+}
+
+// Кадры обрабатываются одним долгоживущим конвейером с тёплыми пулами и буферами
+void ProcessFrames(const InputData& input)
+{
+	FrameStreamConfig config;
+	config.input = input.inputFile;
+	config.output = input.outputFile;
+	config.firstFrame = input.frameStart;
+	config.numThreads = input.numThreads;
+	config.frameWorkers = input.frameWorkers;
+	config.options = input.blurOptions;
+
+	std::cout << "Frames: " << config.input << " -> " << config.output << ", frame workers: "
+			  << std::min(input.frameWorkers, input.numThreads) << "\n";
+	FrameStreamStats stats = FrameStream::Run(config);
+
+	std::cout << "Processed " << stats.frames << " frames in " << stats.wallMs << " ms, " << stats.fps << " FPS\n";
+	std::cout << "Latency: p50 " << stats.latencyP50Ms << " ms, p95 " << stats.latencyP95Ms << " ms, p99 "
+			  << stats.latencyP99Ms << " ms, max " << stats.latencyMaxMs << " ms\n";
+}
+
+int main(int argc, char* argv[])
+{
+	auto start = std::chrono::steady_clock::now();
+
+	InputData input;
+
+	if (!ParseCommandLine(argc, argv, input))
+	{
+		return 1;
+	}
+
+	if (!SetCpuAffinity(input.numCores, input.blurOptions.pinPolicy))
+	{
+		std::cerr << "Failed to set CPU affinity\n";
+		return 1;
+	}
+	PrintTopology(input);
+
+	try
+	{
+		if (input.batch)
+		{
+			ProcessBatch(input);
+		}
+		else if (input.frames)
+		{
+			ProcessFrames(input);
+		}
+		else if (input.useMmap)
+		{
+			ProcessMappedFile(input);
+		}
+		else if (input.streamBudgetMb > 0)
+		{
+			ProcessStreamingFile(input);
+		}
+		else if (input.progressiveRows > 0)
+		{
+			ProcessProgressiveFile(input);
+		}
+		else
+		{
+			ProcessFile(input);
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
 
-	QueryPerformanceCounter(&end);
-	auto time = (end.QuadPart - start.QuadPart) * 1000.0 / freq.QuadPart;
+	auto time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 	std::cout << "Spent time: " << time << "\n";
 
 	return 0;
@@ -0,0 +1,255 @@
+#pragma once
+#include "BmpProcessor.h"
+#include "BoundedQueue.h"
+#include "IncrementalBlur.h"
+#include "PlanarImage.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct StageStats
+{
+	int items = 0;
+	double busyMs = 0;
+};
+
+struct BatchStats
+{
+	int images = 0;
+	double wallMs = 0;
+	StageStats read;
+	StageStats blur;
+	StageStats write;
+	// Изображения, пересчитанные только по изменённым плиткам
+	int incrementalImages = 0;
+};
+
+// Пакетная обработка: чтение, blur и запись идут отдельными стадиями, соединёнными
+// ограниченными очередями. Пока blur занимает пул потоков изображением N, следующее
+// уже читается, а предыдущее записывается
+class BatchProcessor
+{
+public:
+	// Источник - каталог с .bmp файлами или текстовый файл со списком путей по одному в строке
+	static std::vector<std::string> CollectInputs(const std::string& source)
+	{
+		std::vector<std::string> inputs;
+
+		if (std::filesystem::is_directory(source))
+		{
+			for (const auto& entry : std::filesystem::directory_iterator(source))
+			{
+				std::string extension = entry.path().extension().string();
+				std::ranges::transform(extension, extension.begin(), [](unsigned char c) { return std::tolower(c); });
+				if (entry.is_regular_file() && extension == ".bmp")
+				{
+					inputs.push_back(entry.path().string());
+				}
+			}
+			std::ranges::sort(inputs);
+			return inputs;
+		}
+
+		std::ifstream list(source);
+		if (!list)
+		{
+			throw std::runtime_error("Cannot open batch source");
+		}
+		std::string line;
+		while (std::getline(list, line))
+		{
+			if (!line.empty() && line.back() == '\r')
+			{
+				line.pop_back();
+			}
+			if (!line.empty())
+			{
+				inputs.push_back(line);
+			}
+		}
+		return inputs;
+	}
+
+	static BatchStats Run(const std::vector<std::string>& inputs, const std::string& outputDir, int numThreads,
+		const BlurOptions& options = {}, size_t queueCapacity = 2)
+	{
+		std::filesystem::create_directories(outputDir);
+
+		BatchContext context(queueCapacity);
+		context.inputs = &inputs;
+		context.outputDir = outputDir;
+
+		auto start = std::chrono::steady_clock::now();
+		std::thread reader(ReadStage, &context);
+		std::thread writer(WriteStage, &context);
+
+		// Стадия blur выполняется в текущем потоке на общем пуле
+		WorkerPool pool(numThreads, options.pinPolicy);
+		IncrementalBlur incremental(pool, options);
+		try
+		{
+			while (auto item = context.decoded.Pop())
+			{
+				auto blurStart = std::chrono::steady_clock::now();
+				if (options.layout == PixelLayout::Planar)
+				{
+					PlanarBlur::BlurImage(item->data, pool, options);
+				}
+				else if (options.incremental)
+				{
+					IncrementalStats incrementalStats = incremental.Blur(item->data);
+					context.stats.incrementalImages += incrementalStats.full ? 0 : 1;
+				}
+				else
+				{
+					BmpProcessor::BlurImage(item->data, pool, options);
+				}
+				context.stats.blur.busyMs += ElapsedMs(blurStart);
+				++context.stats.blur.items;
+
+				context.blurred.Push(std::move(*item));
+			}
+		}
+		catch (...)
+		{
+			// Закрытая очередь будит чтение, ждущее места, и оно завершается, не дочитав список
+			context.decoded.Close();
+			context.blurred.Close();
+			reader.join();
+			writer.join();
+			throw;
+		}
+		context.blurred.Close();
+
+		reader.join();
+		writer.join();
+
+		context.stats.wallMs = ElapsedMs(start);
+		context.stats.images = context.stats.write.items;
+		return context.stats;
+	}
+
+private:
+	struct BatchItem
+	{
+		std::string outputFile;
+		FileData data;
+	};
+
+	struct BatchContext
+	{
+		explicit BatchContext(size_t capacity)
+			: decoded(capacity)
+			, blurred(capacity)
+		{
+		}
+
+		const std::vector<std::string>* inputs;
+		std::string outputDir;
+		BoundedQueue<BatchItem> decoded;
+		BoundedQueue<BatchItem> blurred;
+		BatchStats stats;
+	};
+
+	static double ElapsedMs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// В отличие от BmpProcessor::Read проверяет заголовки и размер файла, чтобы повреждённый
+	// или неподдерживаемый файл не попал в blur
+	static FileData ReadImage(const std::string& filename)
+	{
+		std::ifstream in(filename, std::ios::binary | std::ios::ate);
+		if (!in)
+		{
+			throw std::runtime_error("Cannot open file");
+		}
+		auto fileSize = static_cast<uint64_t>(in.tellg());
+		in.seekg(0, std::ios::beg);
+
+		FileData data;
+		if (fileSize < sizeof(FileHeader) + sizeof(BitmapHeader)
+			|| !in.read(reinterpret_cast<char*>(&data.header), sizeof(FileHeader))
+			|| !in.read(reinterpret_cast<char*>(&data.bitmapHeader), sizeof(BitmapHeader)))
+		{
+			throw std::runtime_error("File is truncated");
+		}
+
+		uint32_t rowStride = BmpProcessor::ValidateHeaders(data.header, data.bitmapHeader, fileSize);
+		// Ядра blur считают строки снизу вверх по беззнаковой высоте
+		if (data.bitmapHeader.height < 0)
+		{
+			throw std::runtime_error("Top-down BMP files are not supported");
+		}
+
+		data.pixels.resize(static_cast<size_t>(rowStride) * data.GetHeight());
+		in.seekg(data.header.offset_data, std::ios::beg);
+		if (!in.read(reinterpret_cast<char*>(data.pixels.data()), static_cast<std::streamsize>(data.pixels.size())))
+		{
+			throw std::runtime_error("File is truncated");
+		}
+
+		// Результат пишется сразу после заголовков
+		data.header.offset_data = sizeof(FileHeader) + sizeof(BitmapHeader);
+		data.header.file_size = static_cast<uint32_t>(data.header.offset_data + data.pixels.size());
+		data.bitmapHeader.size = sizeof(BitmapHeader);
+		return data;
+	}
+
+	// Ошибка одного файла не останавливает пакет: файл пропускается с сообщением
+	static void ReadStage(BatchContext* context)
+	{
+		for (const std::string& input : *context->inputs)
+		{
+			auto start = std::chrono::steady_clock::now();
+			BatchItem item;
+			try
+			{
+				item.data = ReadImage(input);
+				item.outputFile = (std::filesystem::path(context->outputDir) / std::filesystem::path(input).filename()).string();
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << input << ": " << e.what() << "\n";
+				continue;
+			}
+			context->stats.read.busyMs += ElapsedMs(start);
+			++context->stats.read.items;
+
+			if (!context->decoded.Push(std::move(item)))
+			{
+				break;
+			}
+		}
+
+		context->decoded.Close();
+	}
+
+	static void WriteStage(BatchContext* context)
+	{
+		while (auto item = context->blurred.Pop())
+		{
+			auto start = std::chrono::steady_clock::now();
+			try
+			{
+				BmpProcessor::Write(item->outputFile, item->data);
+				++context->stats.write.items;
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << item->outputFile << ": " << e.what() << "\n";
+			}
+			context->stats.write.busyMs += ElapsedMs(start);
+		}
+	}
+};
@@ -1,12 +1,20 @@
 #pragma once
+#include "SimdBlur.h"
+#include "TileScheduler.h"
+#include "WorkerPool.h"
+
 #include <algorithm>
-#include <bemapiset.h>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <cstdlib>
 #include <fstream>
+#include <initializer_list>
+#include <limits>
+#include <memory>
 #include <numeric>
 #include <random>
 #include <vector>
-#include <windows.h>
 
 #pragma pack(push, 1)
 struct FileHeader
@@ -34,22 +42,72 @@ struct BitmapHeader
 };
 #pragma pack(pop)
 
-struct Square
-{
-	int startX, startY;
-	int endX, endY;
-};
-
 struct ThreadData
 {
-	std::vector<uint8_t>* srcPixels;
-	std::vector<uint8_t>* dstPixels;
+	const uint8_t* srcPixels;
+	uint8_t* dstPixels;
 	uint32_t width;
 	uint32_t height;
 	uint32_t rowStride;
+	int radius;
+	SimdLevel simdLevel;
 	std::vector<Square> squares;
 };
 
+enum class SchedulerType
+{
+	Static,
+	WorkStealing,
+};
+
+// Разбиение изображения между потоками для статического планировщика
+enum class TileShape
+{
+	// numThreads x numThreads квадратов, перемешанных между потоками
+	Squares,
+	// Одна горизонтальная полоса на поток
+	Strips,
+	// Плитки tileSize x tileSize в порядке Z-кривой, поток получает непрерывный отрезок
+	Morton,
+};
+
+// Planar поддерживается только PlanarBlur
+enum class PixelLayout
+{
+	Interleaved,
+	Planar,
+};
+
+struct BlurOptions
+{
+	int radius = 1;
+	SimdLevel simdLevel = SimdBlur::DetectLevel();
+	SchedulerType scheduler = SchedulerType::Static;
+	TileShape tileShape = TileShape::Squares;
+	int tileSize = 64;
+	int temporalDepth = 4;
+	PinPolicy pinPolicy = PinPolicy::None;
+	// Буферы итераций размещаются на NUMA-узлах потоков, которые их обрабатывают
+	bool firstTouch = false;
+	PixelLayout layout = PixelLayout::Interleaved;
+	// Только для BatchProcessor: каждое изображение пересчитывается по отличиям от предыдущего
+	bool incremental = false;
+	std::vector<RegionOfInterest> regionsOfInterest;
+};
+
+struct BlurStats
+{
+	int iterations;
+	double threadStartMs;
+	double bufferCopyMs;
+	int bufferCopies;
+	std::vector<WorkerStats> workers;
+	// От начала итераций до готовности результата в областях интереса и во всём изображении.
+	// Области готовы, когда в последней итерации посчитаны все их плитки
+	double roiCompleteMs;
+	double fullCompleteMs;
+};
+
 struct FileData
 {
 	FileHeader header;
@@ -64,6 +122,8 @@ struct FileData
 class BmpProcessor
 {
 public:
+	static constexpr int ITERATIONS = 17;
+
 	static FileData Read(const std::string& filename)
 	{
 		std::ifstream in(filename, std::ios::binary);
@@ -120,90 +180,193 @@ public:
 		out.close();
 	}
 
-	static void BlurImage(FileData& fileData, int numThreads)
+	// Проверяет заголовки BMP в файле размером fileSize и возвращает шаг строки.
+	// Поддерживается только несжатый 24-битный формат, который умеют обрабатывать ядра blur
+	static uint32_t ValidateHeaders(const FileHeader& header, const BitmapHeader& bitmapHeader, uint64_t fileSize)
 	{
-		auto threadSquares = DivideIntoSquares(fileData.GetWidth(), fileData.GetHeight(), numThreads);
-
-		for (int iter = 0; iter < ITERATIONS; ++iter)
+		if (header.file_type != 0x4D42)
+		{
+			throw std::runtime_error("Not a BMP file");
+		}
+		if (bitmapHeader.size < sizeof(BitmapHeader) || bitmapHeader.size > fileSize - sizeof(FileHeader))
+		{
+			throw std::runtime_error("Unsupported BMP header");
+		}
+		if (bitmapHeader.bit_count != 24 || bitmapHeader.compression != 0)
+		{
+			throw std::runtime_error("Only uncompressed 24-bit BMP is supported");
+		}
+		// Отрицательная высота означает, что строки идут сверху вниз. Для blur порядок строк
+		// не важен, поэтому он просто сохраняется в выходном файле
+		if (bitmapHeader.width <= 0 || bitmapHeader.height == 0 || bitmapHeader.height == std::numeric_limits<int32_t>::min())
 		{
-			auto temp = fileData.pixels;
+			throw std::runtime_error("Invalid image size");
+		}
 
-			std::vector<HANDLE> threads(numThreads);
-			std::vector<ThreadData> threadData(numThreads);
+		uint64_t rowStride = (static_cast<uint64_t>(bitmapHeader.width) * 3 + 3) & ~3ull;
+		uint64_t pixelsSize = rowStride * static_cast<uint64_t>(std::abs(bitmapHeader.height));
 
-			for (int i = 0; i < numThreads; ++i)
-			{
-				threadData[i].srcPixels = &fileData.pixels;
-				threadData[i].dstPixels = &temp;
-				threadData[i].width = fileData.GetWidth();
-				threadData[i].height = fileData.GetHeight();
-				threadData[i].rowStride = fileData.GetRowStride();
-				threadData[i].squares = threadSquares[i];
-
-				threads[i] = CreateThread(nullptr, 0, BlurFunction, &threadData[i], 0, nullptr);
-			}
+		if (header.offset_data < sizeof(FileHeader) + bitmapHeader.size || header.offset_data > fileSize)
+		{
+			throw std::runtime_error("Invalid pixel data offset");
+		}
+		if (pixelsSize > fileSize - header.offset_data)
+		{
+			throw std::runtime_error("File is truncated");
+		}
+		// Смещения в ядрах blur считаются в int
+		if (pixelsSize > static_cast<uint64_t>(std::numeric_limits<int32_t>::max()))
+		{
+			throw std::runtime_error("Image is too large");
+		}
 
-			WaitForMultipleObjects(numThreads, threads.data(), TRUE, INFINITE);
+		return static_cast<uint32_t>(rowStride);
+	}
 
-			for (HANDLE& thread : threads)
-			{
-				CloseHandle(thread);
-			}
+	static BlurStats BlurImage(FileData& fileData, int numThreads, const BlurOptions& options = {})
+	{
+		WorkerPool pool(numThreads, options.pinPolicy);
+		return BlurImage(fileData, pool, options);
+	}
 
-			fileData.pixels = temp;
+	// Вариант с внешним пулом, чтобы потоки не создавались заново для каждого изображения
+	static BlurStats BlurImage(FileData& fileData, WorkerPool& pool, const BlurOptions& options = {})
+	{
+		if (options.firstTouch)
+		{
+			return BlurImageFirstTouch(fileData, pool, options);
 		}
-	}
 
-private:
-	static constexpr int ITERATIONS = 17;
+		// Второй буфер копируется один раз, чтобы сохранить байты выравнивания строк,
+		// дальше буферы только меняются местами
+		auto copyStart = std::chrono::steady_clock::now();
+		std::vector<uint8_t> temp = fileData.pixels;
+		double bufferCopyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - copyStart).count();
 
-	static DWORD WINAPI BlurFunction(LPVOID lpParam)
-	{
-		auto* data = static_cast<ThreadData*>(lpParam);
+		BlurStats stats = BlurPixels(fileData.pixels.data(), temp.data(), fileData.pixels.data(),
+			fileData.GetWidth(), fileData.GetHeight(), fileData.GetRowStride(), pool, options);
+		stats.bufferCopyMs = bufferCopyMs;
+		stats.bufferCopies = 1;
 
-		for (const Square& square : data->squares)
+		// После нечётного числа итераций результат лежит во втором буфере
+		if (ITERATIONS % 2 == 1)
 		{
-			ApplyBoxBlurToSquare(*data->srcPixels, *data->dstPixels, square,
-				data->width, data->height, data->rowStride);
+			fileData.pixels.swap(temp);
 		}
 
-		return 0;
+		return stats;
 	}
 
-	static void ApplyBoxBlurToSquare(const std::vector<uint8_t>& src, std::vector<uint8_t>& dst,
-		const Square& square, uint32_t width, uint32_t height, uint32_t rowStride)
+	// Первая итерация читает input и пишет в first, дальше first и second чередуются,
+	// так что при нечётном числе итераций результат оказывается в first, иначе в second.
+	// input может совпадать с second, но не с first. Меньше ITERATIONS итераций нужно
+	// только для пробных прогонов TileAutotuner
+	static BlurStats BlurPixels(const uint8_t* input, uint8_t* first, uint8_t* second,
+		uint32_t width, uint32_t height, uint32_t rowStride, WorkerPool& pool, const BlurOptions& options = {},
+		int iterations = ITERATIONS)
 	{
-		for (int y = square.startY; y < square.endY; ++y)
+		int numThreads = pool.Size();
+		// При first touch каждый поток считает ту полосу, страницы которой он разместил
+		auto threadSquares = options.firstTouch
+			? DivideIntoBands(width, height, numThreads)
+			: DivideIntoShape(width, height, numThreads, options.tileShape, options.tileSize);
+
+		// Плитки областей интереса идут первыми в списке каждого потока
+		TilePriorities priorities(options.regionsOfInterest, static_cast<int>(height));
+		for (auto& squares : threadSquares)
 		{
-			for (int x = square.startX; x < square.endX; ++x)
+			priorities.Sort(squares);
+		}
+
+		BlurStats stats{};
+		stats.iterations = iterations;
+		stats.threadStartMs = pool.GetStartupMs();
+
+		std::vector<ThreadData> threadData(numThreads);
+		for (int i = 0; i < numThreads; ++i)
+		{
+			threadData[i].srcPixels = input;
+			threadData[i].dstPixels = first;
+			threadData[i].width = width;
+			threadData[i].height = height;
+			threadData[i].rowStride = rowStride;
+			threadData[i].radius = options.radius;
+			threadData[i].simdLevel = options.simdLevel;
+			threadData[i].squares = threadSquares[i];
+		}
+
+		auto nextIteration = [&](ThreadData& data) {
+			data.srcPixels = data.dstPixels;
+			data.dstPixels = data.dstPixels == first ? second : first;
+		};
+
+		// Последняя плитка областей интереса в последней итерации отмечает их готовность
+		auto start = std::chrono::steady_clock::now();
+		std::atomic<int> roiRemaining = 0;
+		auto blurTile = [&](const ThreadData& data, const Square& tile, int iter) {
+			BlurSquare(data, tile);
+			if (iter == iterations - 1 && !priorities.IsEmpty() && priorities.Get(tile) > 0 && roiRemaining.fetch_sub(1) == 1)
 			{
-				int r = 0, g = 0, b = 0, count = 0;
+				stats.roiCompleteMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			}
+		};
 
-				// Box blur 3x3
-				for (int dy = -1; dy <= 1; ++dy)
+		if (options.scheduler == SchedulerType::WorkStealing)
+		{
+			auto tiles = DivideIntoTiles(width, height, options.tileSize);
+			priorities.Sort(tiles);
+			size_t roiTiles = std::ranges::count_if(tiles, [&](const Square& tile) { return priorities.Get(tile) > 0; });
+			roiRemaining = static_cast<int>(roiTiles);
+			WorkStealingScheduler scheduler(numThreads);
+
+			pool.Run([&](int index) {
+				ThreadData& data = threadData[index];
+				for (int iter = 0; iter < iterations; ++iter)
 				{
-					for (int dx = -1; dx <= 1; ++dx)
+					if (priorities.IsEmpty())
 					{
-						int ny = y + dy;
-						int nx = x + dx;
+						scheduler.Fill(index, tiles);
+					}
+					else
+					{
+						scheduler.FillByPriority(index, tiles, roiTiles);
+					}
+					pool.Barrier();
 
-						if (ny >= 0 && ny < static_cast<int>(height) && nx >= 0 && nx < static_cast<int>(width))
-						{
-							int offset = ny * rowStride + nx * 3;
-							b += src[offset + 0];
-							g += src[offset + 1];
-							r += src[offset + 2];
-							++count;
-						}
+					Square tile{};
+					while (scheduler.Next(index, tile))
+					{
+						blurTile(data, tile, iter);
 					}
+					nextIteration(data);
+					pool.Barrier();
 				}
-
-				int offset = y * rowStride + x * 3;
-				dst[offset + 0] = static_cast<uint8_t>(b / count);
-				dst[offset + 1] = static_cast<uint8_t>(g / count);
-				dst[offset + 2] = static_cast<uint8_t>(r / count);
+			});
+			stats.workers = scheduler.GetStats();
+		}
+		else
+		{
+			for (const auto& squares : threadSquares)
+			{
+				roiRemaining += static_cast<int>(std::ranges::count_if(squares, [&](const Square& tile) { return priorities.Get(tile) > 0; }));
 			}
+
+			pool.Run([&](int index) {
+				ThreadData& data = threadData[index];
+				for (int iter = 0; iter < iterations; ++iter)
+				{
+					for (const Square& square : data.squares)
+					{
+						blurTile(data, square, iter);
+					}
+					nextIteration(data);
+					pool.Barrier();
+				}
+			});
 		}
+
+		stats.fullCompleteMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return stats;
 	}
 
 	static std::vector<std::vector<Square>> DivideIntoSquares(uint32_t width, uint32_t height, int numThreads)
@@ -245,4 +408,280 @@ private:
 
 		return result;
 	}
+
+	static std::vector<std::vector<Square>> DivideIntoShape(uint32_t width, uint32_t height, int numThreads,
+		TileShape shape, int tileSize)
+	{
+		switch (shape)
+		{
+		case TileShape::Strips:
+			return DivideIntoBands(width, height, numThreads);
+		case TileShape::Morton:
+			return DivideIntoMortonTiles(width, height, numThreads, tileSize);
+		default:
+			return DivideIntoSquares(width, height, numThreads);
+		}
+	}
+
+	// Одна горизонтальная полоса на поток
+	static std::vector<std::vector<Square>> DivideIntoBands(uint32_t width, uint32_t height, int numThreads)
+	{
+		std::vector<std::vector<Square>> result(numThreads);
+		for (int i = 0; i < numThreads; ++i)
+		{
+			int startY = static_cast<int>(static_cast<int64_t>(height) * i / numThreads);
+			int endY = static_cast<int>(static_cast<int64_t>(height) * (i + 1) / numThreads);
+			result[i].push_back({ 0, startY, static_cast<int>(width), endY });
+		}
+		return result;
+	}
+
+	// Соседние по Z-кривой плитки близки по обеим осям, поэтому непрерывный отрезок
+	// плиток потока компактен и его ореол из соседних строк остаётся в кэше
+	static std::vector<std::vector<Square>> DivideIntoMortonTiles(uint32_t width, uint32_t height, int numThreads, int tileSize)
+	{
+		auto tiles = DivideIntoTiles(width, height, tileSize);
+		auto mortonKey = [tileSize](const Square& tile) {
+			uint64_t key = 0;
+			uint32_t x = static_cast<uint32_t>(tile.startX / tileSize);
+			uint32_t y = static_cast<uint32_t>(tile.startY / tileSize);
+			for (int bit = 0; bit < 32; ++bit)
+			{
+				key |= static_cast<uint64_t>((x >> bit) & 1) << (2 * bit);
+				key |= static_cast<uint64_t>((y >> bit) & 1) << (2 * bit + 1);
+			}
+			return key;
+		};
+		std::ranges::sort(tiles, {}, mortonKey);
+
+		std::vector<std::vector<Square>> result(numThreads);
+		for (int i = 0; i < numThreads; ++i)
+		{
+			size_t begin = tiles.size() * i / numThreads;
+			size_t end = tiles.size() * (i + 1) / numThreads;
+			result[i].assign(tiles.begin() + begin, tiles.begin() + end);
+		}
+		return result;
+	}
+
+	// Внутренняя часть квадрата считается без проверок границ векторным ядром,
+	// а пиксели на краю изображения - обычным ApplyBoxBlurToSquare
+	static void ApplySimdBoxBlurToSquare(const uint8_t* src, uint8_t* dst,
+		const Square& square, uint32_t width, uint32_t height, uint32_t rowStride, SimdLevel simdLevel)
+	{
+		int innerStartX = std::max(square.startX, 1);
+		int innerEndX = std::min(square.endX, static_cast<int>(width) - 1);
+		int innerStartY = std::max(square.startY, 1);
+		int innerEndY = std::min(square.endY, static_cast<int>(height) - 1);
+
+		if (innerStartX >= innerEndX || innerStartY >= innerEndY)
+		{
+			ApplyBoxBlurToSquare(src, dst, square, width, height, rowStride);
+			return;
+		}
+
+		const Square borders[] = {
+			{ square.startX, square.startY, square.endX, innerStartY },
+			{ square.startX, innerEndY, square.endX, square.endY },
+			{ square.startX, innerStartY, innerStartX, innerEndY },
+			{ innerEndX, innerStartY, square.endX, innerEndY },
+		};
+		for (const Square& border : borders)
+		{
+			ApplyBoxBlurToSquare(src, dst, border, width, height, rowStride);
+		}
+
+		for (int y = innerStartY; y < innerEndY; ++y)
+		{
+			const uint8_t* row = src + y * rowStride;
+			SimdBlur::BlurInteriorRow(simdLevel, row - rowStride, row, row + rowStride,
+				dst + y * rowStride, innerStartX * 3, innerEndX * 3);
+		}
+	}
+
+	// Плитки tileSize x tileSize по строкам, для динамического распределения
+	static std::vector<Square> DivideIntoTiles(uint32_t width, uint32_t height, int tileSize)
+	{
+		std::vector<Square> tiles;
+		for (int y = 0; y < static_cast<int>(height); y += tileSize)
+		{
+			for (int x = 0; x < static_cast<int>(width); x += tileSize)
+			{
+				tiles.push_back({ x, y,
+					std::min(x + tileSize, static_cast<int>(width)),
+					std::min(y + tileSize, static_cast<int>(height)) });
+			}
+		}
+		return tiles;
+	}
+
+	// Одна итерация blur для square: читает data.srcPixels, пишет data.dstPixels
+	static void BlurSquare(const ThreadData& data, const Square& square)
+	{
+		if (data.radius == 1)
+		{
+			ApplySimdBoxBlurToSquare(data.srcPixels, data.dstPixels, square,
+				data.width, data.height, data.rowStride, data.simdLevel);
+		}
+		else
+		{
+			ApplySlidingBoxBlurToSquare(data.srcPixels, data.dstPixels, square,
+				data.width, data.height, data.rowStride, data.radius);
+		}
+	}
+
+private:
+	// Оба буфера выделяются без инициализации, и каждый поток первым записывает строки
+	// своей полосы, поэтому ОС размещает эти страницы на узле потока. Потокам нужна привязка
+	// к CPU, иначе планировщик может увести их с узла. Исходное изображение читается
+	// из чужой памяти только при начальном копировании, результат копируется обратно
+	static BlurStats BlurImageFirstTouch(FileData& fileData, WorkerPool& pool, const BlurOptions& options)
+	{
+		uint32_t width = fileData.GetWidth();
+		uint32_t height = fileData.GetHeight();
+		uint32_t rowStride = fileData.GetRowStride();
+		auto bands = DivideIntoBands(width, height, pool.Size());
+
+		auto first = std::make_unique_for_overwrite<uint8_t[]>(fileData.pixels.size());
+		auto second = std::make_unique_for_overwrite<uint8_t[]>(fileData.pixels.size());
+
+		auto copyBands = [&](const uint8_t* from, std::initializer_list<uint8_t*> to) {
+			pool.Run([&](int index) {
+				size_t begin = static_cast<size_t>(bands[index][0].startY) * rowStride;
+				size_t end = static_cast<size_t>(bands[index][0].endY) * rowStride;
+				for (uint8_t* buffer : to)
+				{
+					std::copy(from + begin, from + end, buffer + begin);
+				}
+			});
+		};
+
+		auto copyStart = std::chrono::steady_clock::now();
+		copyBands(fileData.pixels.data(), { first.get(), second.get() });
+		double bufferCopyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - copyStart).count();
+
+		BlurStats stats = BlurPixels(second.get(), first.get(), second.get(), width, height, rowStride, pool, options);
+
+		copyStart = std::chrono::steady_clock::now();
+		copyBands(ITERATIONS % 2 == 1 ? first.get() : second.get(), { fileData.pixels.data() });
+		stats.bufferCopyMs = bufferCopyMs + std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - copyStart).count();
+		stats.bufferCopies = 3;
+		return stats;
+	}
+
+	static void ApplyBoxBlurToSquare(const uint8_t* src, uint8_t* dst,
+		const Square& square, uint32_t width, uint32_t height, uint32_t rowStride)
+	{
+		for (int y = square.startY; y < square.endY; ++y)
+		{
+			for (int x = square.startX; x < square.endX; ++x)
+			{
+				int r = 0, g = 0, b = 0, count = 0;
+
+				// Box blur 3x3
+				for (int dy = -1; dy <= 1; ++dy)
+				{
+					for (int dx = -1; dx <= 1; ++dx)
+					{
+						int ny = y + dy;
+						int nx = x + dx;
+
+						if (ny >= 0 && ny < static_cast<int>(height) && nx >= 0 && nx < static_cast<int>(width))
+						{
+							int offset = ny * rowStride + nx * 3;
+							b += src[offset + 0];
+							g += src[offset + 1];
+							r += src[offset + 2];
+							++count;
+						}
+					}
+				}
+
+				int offset = y * rowStride + x * 3;
+				dst[offset + 0] = static_cast<uint8_t>(b / count);
+				dst[offset + 1] = static_cast<uint8_t>(g / count);
+				dst[offset + 2] = static_cast<uint8_t>(r / count);
+			}
+		}
+	}
+
+	// Box blur произвольного радиуса скользящим окном: суммы по столбцам окна сдвигаются
+	// на строку вниз, а по ним скользит горизонтальное окно, поэтому стоимость пикселя
+	// не зависит от радиуса. Края обрабатываются так же, как в ApplyBoxBlurToSquare
+	static void ApplySlidingBoxBlurToSquare(const uint8_t* src, uint8_t* dst,
+		const Square& square, uint32_t width, uint32_t height, uint32_t rowStride, int radius)
+	{
+		int w = static_cast<int>(width);
+		int h = static_cast<int>(height);
+
+		// Столбцы, которые попадают в окна пикселей квадрата
+		int firstColumn = std::max(0, square.startX - radius);
+		int lastColumn = std::min(w, square.endX + radius);
+		std::vector<uint32_t> columnSums((lastColumn - firstColumn) * 3, 0);
+
+		auto addRow = [&](int y, int sign) {
+			const uint8_t* row = src + y * rowStride;
+			for (int x = firstColumn; x < lastColumn; ++x)
+			{
+				for (int c = 0; c < 3; ++c)
+				{
+					columnSums[(x - firstColumn) * 3 + c] += sign * row[x * 3 + c];
+				}
+			}
+		};
+
+		for (int y = std::max(0, square.startY - radius); y < std::min(h, square.startY + radius + 1); ++y)
+		{
+			addRow(y, 1);
+		}
+
+		for (int y = square.startY; y < square.endY; ++y)
+		{
+			if (y > square.startY)
+			{
+				if (y + radius < h)
+				{
+					addRow(y + radius, 1);
+				}
+				if (y - radius - 1 >= 0)
+				{
+					addRow(y - radius - 1, -1);
+				}
+			}
+			int rowsCount = std::min(h - 1, y + radius) - std::max(0, y - radius) + 1;
+
+			uint32_t sums[3] = { 0, 0, 0 };
+			for (int x = std::max(0, square.startX - radius); x < std::min(w, square.startX + radius + 1); ++x)
+			{
+				for (int c = 0; c < 3; ++c)
+				{
+					sums[c] += columnSums[(x - firstColumn) * 3 + c];
+				}
+			}
+
+			for (int x = square.startX; x < square.endX; ++x)
+			{
+				if (x > square.startX)
+				{
+					for (int c = 0; c < 3; ++c)
+					{
+						if (x + radius < w)
+						{
+							sums[c] += columnSums[(x + radius - firstColumn) * 3 + c];
+						}
+						if (x - radius - 1 >= 0)
+						{
+							sums[c] -= columnSums[(x - radius - 1 - firstColumn) * 3 + c];
+						}
+					}
+				}
+				uint32_t count = rowsCount * (std::min(w - 1, x + radius) - std::max(0, x - radius) + 1);
+
+				int offset = y * rowStride + x * 3;
+				dst[offset + 0] = static_cast<uint8_t>(sums[0] / count);
+				dst[offset + 1] = static_cast<uint8_t>(sums[1] / count);
+				dst[offset + 2] = static_cast<uint8_t>(sums[2] / count);
+			}
+		}
+	}
 };
\ No newline at end of file
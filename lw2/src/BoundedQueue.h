@@ -0,0 +1,63 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+// Очередь между стадиями конвейера. Push ждёт, пока освободится место,
+// поэтому быстрая стадия не может накопить в памяти больше capacity элементов
+template <typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t capacity)
+		: m_capacity(capacity)
+	{
+	}
+
+	// false - очередь закрыта, элемент отброшен
+	bool Push(T item)
+	{
+		std::unique_lock lock(m_mutex);
+		m_notFull.wait(lock, [this] { return m_items.size() < m_capacity || m_closed; });
+		if (m_closed)
+		{
+			return false;
+		}
+		m_items.push_back(std::move(item));
+		m_notEmpty.notify_one();
+		return true;
+	}
+
+	// Пустой результат означает, что очередь закрыта и все элементы разобраны
+	std::optional<T> Pop()
+	{
+		std::unique_lock lock(m_mutex);
+		m_notEmpty.wait(lock, [this] { return !m_items.empty() || m_closed; });
+		if (m_items.empty())
+		{
+			return std::nullopt;
+		}
+
+		T item = std::move(m_items.front());
+		m_items.pop_front();
+		m_notFull.notify_one();
+		return item;
+	}
+
+	void Close()
+	{
+		std::lock_guard lock(m_mutex);
+		m_closed = true;
+		m_notEmpty.notify_all();
+		m_notFull.notify_all();
+	}
+
+private:
+	size_t m_capacity;
+	std::deque<T> m_items;
+	bool m_closed = false;
+	std::mutex m_mutex;
+	std::condition_variable m_notFull;
+	std::condition_variable m_notEmpty;
+};
@@ -0,0 +1,608 @@
+#pragma once
+#include "BmpProcessor.h"
+#include "SimdBlur.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Ядро свёртки с целыми весами: результат = сумма(вес * пиксель) / divisor с округлением.
+// У сепарабельного ядра weights - size весов одной оси, которые применяются по обеим осям,
+// и divisor делит итоговую двумерную сумму. За краем изображения повторяется крайний пиксель
+struct ConvolutionKernel
+{
+	int size;
+	bool separable;
+	std::vector<int> weights;
+	int divisor;
+
+	int Radius() const { return size / 2; }
+
+	// Биномиальные веса приближают гауссиан, и сумма оси - степень двойки
+	static ConvolutionKernel Gaussian(int size)
+	{
+		ValidateSize(size);
+		std::vector<int> row{ 1 };
+		for (int i = 1; i < size; ++i)
+		{
+			std::vector<int> next(row.size() + 1, 0);
+			for (size_t j = 0; j < row.size(); ++j)
+			{
+				next[j] += row[j];
+				next[j + 1] += row[j];
+			}
+			row = next;
+		}
+		return Make(size, true, row);
+	}
+
+	static ConvolutionKernel Box(int size)
+	{
+		ValidateSize(size);
+		return Make(size, true, std::vector<int>(size, 1));
+	}
+
+	// size весов задают сепарабельное ядро, size * size - полное.
+	// Делитель - сумма весов, а если она не положительна, то 1
+	static ConvolutionKernel Custom(const std::vector<int>& weights)
+	{
+		int size = static_cast<int>(std::lround(std::sqrt(static_cast<double>(weights.size()))));
+		bool separable = size * size != static_cast<int>(weights.size());
+		if (separable)
+		{
+			size = static_cast<int>(weights.size());
+		}
+		ValidateSize(size);
+		return Make(size, separable, weights);
+	}
+
+private:
+	// Суммы пикселей с весами, округление и делитель считаются в int, а Divider
+	// принимает числа меньше 2^31, поэтому (255 + 1) * сумма |весов| не должна превышать INT32_MAX.
+	// Для гауссиана это размер до 11
+	static constexpr int64_t MAX_ABS_WEIGHT_SUM = INT32_MAX / 256;
+
+	static void ValidateSize(int size)
+	{
+		if (size < 1 || size % 2 == 0 || size > 31)
+		{
+			throw std::runtime_error("Kernel size must be odd and in [1,31]");
+		}
+	}
+
+	// Сумма и сумма модулей весов двумерного ядра считаются в int64_t, так что проверка
+	// не переполняется сама
+	static ConvolutionKernel Make(int size, bool separable, const std::vector<int>& weights)
+	{
+		int64_t sum = 0;
+		int64_t absSum = 0;
+		for (int weight : weights)
+		{
+			sum += weight;
+			absSum += std::abs(static_cast<int64_t>(weight));
+		}
+		if (separable)
+		{
+			if (absSum > MAX_ABS_WEIGHT_SUM)
+			{
+				throw std::runtime_error("Kernel weights are too large");
+			}
+			sum *= sum;
+			absSum *= absSum;
+		}
+		if (absSum > MAX_ABS_WEIGHT_SUM)
+		{
+			throw std::runtime_error("Kernel weights are too large");
+		}
+		return { size, separable, weights, sum > 0 ? static_cast<int>(sum) : 1 };
+	}
+};
+
+// Деление неотрицательного x < 2^31 на d умножением: (x * multiplier) >> shift == x / d
+// при shift = 31 + ceil(log2(d)). Множитель помещается в 32 бита, поэтому произведение
+// векторизуется умножением 32x32->64
+struct Divider
+{
+	uint32_t multiplier;
+	int shift;
+	int log2;
+	bool powerOfTwo;
+	float reciprocal;
+
+	explicit Divider(uint32_t divisor)
+		: log2(0)
+		, reciprocal(1.0f / static_cast<float>(divisor))
+	{
+		while ((uint64_t{ 1 } << log2) < divisor)
+		{
+			++log2;
+		}
+		powerOfTwo = (uint64_t{ 1 } << log2) == divisor;
+		shift = 31 + log2;
+		multiplier = static_cast<uint32_t>((uint64_t{ 1 } << shift) / divisor + 1);
+	}
+
+	uint32_t Divide(uint32_t x) const { return static_cast<uint32_t>((static_cast<uint64_t>(x) * multiplier) >> shift); }
+};
+
+#ifdef SIMD_BLUR_X64
+// SSE2-ядра свёртки для случая, когда горизонтальные суммы помещаются в int16_t:
+// тогда 8 сумм обрабатываются одной командой, как 16-битные суммы в SimdBlur
+class SimdConvolution
+{
+public:
+	static constexpr int MAX_SIZE = 31;
+
+	// 255 * сумма |весов| строки ядра не больше INT16_MAX, а деление точно в float
+	static bool Supports(const ConvolutionKernel& kernel)
+	{
+		int absSum = 0;
+		for (int weight : kernel.weights)
+		{
+			absSum += std::abs(weight);
+		}
+		bool exactDivide = (kernel.divisor & (kernel.divisor - 1)) == 0 || kernel.divisor <= MAX_FLOAT_DIVISOR;
+		return kernel.size <= MAX_SIZE && 255 * absSum <= INT16_MAX && exactDivide;
+	}
+
+	// out[i] (+)= сумма weights[k] * base[i + 3k] для i из [0, count), возвращает число обработанных байтов
+	template <int Size, bool Accumulate>
+	static int HorizontalRow(const uint8_t* base, int16_t* out, int count, const int* weights, int runtimeSize)
+	{
+		const int size = Size > 0 ? Size : runtimeSize;
+		const __m128i zero = _mm_setzero_si128();
+		__m128i factors[MAX_SIZE];
+		for (int k = 0; k < size; ++k)
+		{
+			factors[k] = _mm_set1_epi16(static_cast<short>(weights[k]));
+		}
+
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i low = zero;
+			__m128i high = zero;
+			for (int k = 0; k < size; ++k)
+			{
+				__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base + i + k * 3));
+				low = _mm_add_epi16(low, _mm_mullo_epi16(_mm_unpacklo_epi8(pixels, zero), factors[k]));
+				high = _mm_add_epi16(high, _mm_mullo_epi16(_mm_unpackhi_epi8(pixels, zero), factors[k]));
+			}
+			if constexpr (Accumulate)
+			{
+				low = _mm_add_epi16(low, _mm_loadu_si128(reinterpret_cast<const __m128i*>(out + i)));
+				high = _mm_add_epi16(high, _mm_loadu_si128(reinterpret_cast<const __m128i*>(out + i + 8)));
+			}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), low);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), high);
+		}
+		return i;
+	}
+
+	// out[i] = сумма weights[k] * sums[k][i] / divisor. Строки сумм чередуются попарно,
+	// и _mm_madd_epi16 сразу даёт 32-битную сумму двух слагаемых
+	template <int Size>
+	static int VerticalRow(const int16_t* const* sums, uint8_t* out, int count, const int* weights, int runtimeSize,
+		int half, const Divider& divider)
+	{
+		const int size = Size > 0 ? Size : runtimeSize;
+		__m128i pairs[(MAX_SIZE + 1) / 2];
+		for (int k = 0; k < size; k += 2)
+		{
+			int next = k + 1 < size ? weights[k + 1] : 0;
+			pairs[k / 2] = _mm_set1_epi32(static_cast<int>((static_cast<uint32_t>(next) << 16) | (weights[k] & 0xFFFF)));
+		}
+
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i acc[4] = { _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128() };
+			for (int k = 0; k < size; k += 2)
+			{
+				// У непарной последней строки вес соседа нулевой, и читается она же
+				const int16_t* first = sums[k] + i;
+				const int16_t* second = k + 1 < size ? sums[k + 1] + i : first;
+				for (int part = 0; part < 2; ++part)
+				{
+					__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first + part * 8));
+					__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(second + part * 8));
+					acc[part * 2] = _mm_add_epi32(acc[part * 2], _mm_madd_epi16(_mm_unpacklo_epi16(a, b), pairs[k / 2]));
+					acc[part * 2 + 1] = _mm_add_epi32(acc[part * 2 + 1], _mm_madd_epi16(_mm_unpackhi_epi16(a, b), pairs[k / 2]));
+				}
+			}
+			Store(out + i, acc, half, divider);
+		}
+		return i;
+	}
+
+	// out[i] = sums[i] / divisor для готовых 16-битных сумм полного ядра
+	static int StoreRow(const int16_t* sums, uint8_t* out, int count, int half, const Divider& divider)
+	{
+		int i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i acc[4];
+			for (int part = 0; part < 2; ++part)
+			{
+				__m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + i + part * 8));
+				// Знаковое расширение до 32 бит
+				acc[part * 2] = _mm_srai_epi32(_mm_unpacklo_epi16(values, values), 16);
+				acc[part * 2 + 1] = _mm_srai_epi32(_mm_unpackhi_epi16(values, values), 16);
+			}
+			Store(out + i, acc, half, divider);
+		}
+		return i;
+	}
+
+private:
+	// (x + half + 0.5) / d отстоит от целого не меньше чем на 0.5 / d, и при d <= 4096
+	// погрешности float не хватает, чтобы перейти через целое для результатов до 255
+	static constexpr int MAX_FLOAT_DIVISOR = 4096;
+
+	// 16 сумм в 32 битах делятся с округлением, а packs/packus ограничивают их 0..255
+	static void Store(uint8_t* out, __m128i* acc, int half, const Divider& divider)
+	{
+		const __m128i halfVector = _mm_set1_epi32(half);
+		for (int part = 0; part < 4; ++part)
+		{
+			__m128i value = _mm_add_epi32(acc[part], halfVector);
+			if (divider.powerOfTwo)
+			{
+				acc[part] = _mm_sra_epi32(value, _mm_cvtsi32_si128(divider.log2));
+			}
+			else
+			{
+				__m128 scaled = _mm_add_ps(_mm_cvtepi32_ps(value), _mm_set1_ps(0.5f));
+				acc[part] = _mm_cvttps_epi32(_mm_mul_ps(scaled, _mm_set1_ps(divider.reciprocal)));
+			}
+		}
+		__m128i low = _mm_packs_epi32(acc[0], acc[1]);
+		__m128i high = _mm_packs_epi32(acc[2], acc[3]);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(low, high));
+	}
+};
+#endif
+
+// Буферы сумм одного потока, переиспользуются между квадратами
+struct ConvolutionScratch
+{
+	std::vector<int> wide;
+	std::vector<int16_t> narrow;
+};
+
+// Свёртка одного квадрата. Size > 0 - размер ядра известен при компиляции, и циклы по ядру
+// разворачиваются, Size == 0 - размер берётся из ядра во время выполнения.
+// BGR чередуются, поэтому, как в SimdBlur, строка обрабатывается как массив байтов с шагом 3
+template <int Size, bool Separable>
+class ConvolutionEngine
+{
+public:
+	// vectorized - ядро прошло SimdConvolution::Supports, и суммы строк считаются в int16_t
+	static void ApplyToSquare(const uint8_t* src, uint8_t* dst, const Square& square, uint32_t width, uint32_t height,
+		uint32_t rowStride, const ConvolutionKernel& kernel, bool vectorized, ConvolutionScratch& scratch)
+	{
+		// DivideIntoSquares даёт пустые квадраты, когда потоков больше, чем пикселей по стороне
+		if (square.startX >= square.endX || square.startY >= square.endY)
+		{
+			return;
+		}
+
+#ifdef SIMD_BLUR_X64
+		if (vectorized)
+		{
+			Apply(src, dst, square, width, height, rowStride, kernel, scratch.narrow);
+			return;
+		}
+#endif
+		Apply(src, dst, square, width, height, rowStride, kernel, scratch.wide);
+	}
+
+private:
+	// Скалярные циклы идут блоками по BLOCK байтов через локальный массив: запись в uint8_t
+	// или int может пересекаться с исходной строкой, и без блоков компилятор не векторизует цикл
+	static constexpr int BLOCK = 16;
+
+	template <typename Sum>
+	static void Apply(const uint8_t* src, uint8_t* dst, const Square& square, uint32_t width, uint32_t height,
+		uint32_t rowStride, const ConvolutionKernel& kernel, std::vector<Sum>& temp)
+	{
+		const int size = Size > 0 ? Size : kernel.size;
+		const int radius = size / 2;
+		const int rowBytes = (square.endX - square.startX) * 3;
+		// Блоки читают до BLOCK сумм за концом строки
+		const int tempPitch = rowBytes + BLOCK;
+		const int half = kernel.divisor / 2;
+		const Divider divider(kernel.divisor);
+
+		// Веса копируются в локальный массив, чтобы компилятор не опасался их пересечения с temp
+		std::array<int, (Size > 0 ? Size * Size : 1)> fixedWeights{};
+		const int* weights = kernel.weights.data();
+		if constexpr (Size > 0)
+		{
+			std::copy_n(kernel.weights.begin(), kernel.weights.size(), fixedWeights.begin());
+			weights = fixedWeights.data();
+		}
+
+		// За верхним и нижним краем повторяются крайние строки
+		auto sourceRow = [&](int y) {
+			return src + static_cast<size_t>(std::clamp(y, 0, static_cast<int>(height) - 1)) * rowStride;
+		};
+
+		if constexpr (Separable)
+		{
+			std::array<const Sum*, (Size > 0 ? Size : 1)> fixedSums{};
+			std::vector<const Sum*> dynamicSums(Size > 0 ? 0 : size);
+			const Sum** sums = Size > 0 ? fixedSums.data() : dynamicSums.data();
+
+			// Горизонтальные суммы последних size строк лежат в temp по кругу,
+			// так что каждая строка источника проходится по x один раз
+			temp.resize(static_cast<size_t>(size) * tempPitch);
+			auto ringRow = [&](int index) { return temp.data() + static_cast<size_t>(index % size) * tempPitch; };
+
+			for (int index = 0; index < size - 1; ++index)
+			{
+				HorizontalRow<false>(sourceRow(square.startY - radius + index), ringRow(index), square, width, weights, size);
+			}
+
+			for (int y = square.startY; y < square.endY; ++y)
+			{
+				int first = y - square.startY;
+				HorizontalRow<false>(sourceRow(y + radius), ringRow(first + size - 1), square, width, weights, size);
+				for (int k = 0; k < size; ++k)
+				{
+					sums[k] = ringRow(first + k);
+				}
+
+				uint8_t* out = dst + static_cast<size_t>(y) * rowStride + square.startX * 3;
+				int i = 0;
+#ifdef SIMD_BLUR_X64
+				if constexpr (std::is_same_v<Sum, int16_t>)
+				{
+					i = SimdConvolution::VerticalRow<Size>(sums, out, rowBytes, weights, size, half, divider);
+				}
+#endif
+				for (; i < rowBytes; i += BLOCK)
+				{
+					int block[BLOCK] = {};
+					for (int k = 0; k < size; ++k)
+					{
+						for (int j = 0; j < BLOCK; ++j)
+						{
+							block[j] += weights[k] * sums[k][i + j];
+						}
+					}
+					Store(out + i, block, std::min(BLOCK, rowBytes - i), half, divider);
+				}
+			}
+		}
+		else
+		{
+			temp.resize(tempPitch);
+
+			for (int y = square.startY; y < square.endY; ++y)
+			{
+				HorizontalRow<false>(sourceRow(y - radius), temp.data(), square, width, weights, size);
+				for (int ky = 1; ky < size; ++ky)
+				{
+					HorizontalRow<true>(sourceRow(y - radius + ky), temp.data(), square, width, weights + ky * size, size);
+				}
+
+				uint8_t* out = dst + static_cast<size_t>(y) * rowStride + square.startX * 3;
+				int i = 0;
+#ifdef SIMD_BLUR_X64
+				if constexpr (std::is_same_v<Sum, int16_t>)
+				{
+					i = SimdConvolution::StoreRow(temp.data(), out, rowBytes, half, divider);
+				}
+#endif
+				for (; i < rowBytes; i += BLOCK)
+				{
+					int block[BLOCK];
+					for (int j = 0; j < BLOCK; ++j)
+					{
+						block[j] = temp[i + j];
+					}
+					Store(out + i, block, std::min(BLOCK, rowBytes - i), half, divider);
+				}
+			}
+		}
+	}
+
+	static void Store(uint8_t* out, const int* sums, int count, int half, const Divider& divider)
+	{
+		uint8_t block[BLOCK];
+		// Для делителя - степени двойки, как у гауссиана, хватает сдвига
+		if (divider.powerOfTwo)
+		{
+			for (int j = 0; j < BLOCK; ++j)
+			{
+				block[j] = static_cast<uint8_t>(std::clamp((sums[j] + half) >> divider.log2, 0, 255));
+			}
+		}
+		else
+		{
+			for (int j = 0; j < BLOCK; ++j)
+			{
+				int rounded = std::max(sums[j] + half, 0);
+				block[j] = static_cast<uint8_t>(std::min<uint32_t>(divider.Divide(rounded), 255));
+			}
+		}
+		std::copy_n(block, count, out);
+	}
+
+	// Одномерная свёртка строки по x для столбцов квадрата, Accumulate добавляет к out
+	template <bool Accumulate, typename Sum>
+	static void HorizontalRow(const uint8_t* row, Sum* out, const Square& square, uint32_t width,
+		const int* weights, int runtimeSize)
+	{
+		const int size = Size > 0 ? Size : runtimeSize;
+		const int radius = size / 2;
+		// Внутри [innerStart, innerEnd) все соседи по x существуют
+		int innerStart = std::clamp(radius, square.startX, square.endX);
+		int innerEnd = std::clamp(static_cast<int>(width) - radius, innerStart, square.endX);
+
+		auto store = [&](int index, int sum) {
+			if constexpr (Accumulate)
+			{
+				out[index] = static_cast<Sum>(out[index] + sum);
+			}
+			else
+			{
+				out[index] = static_cast<Sum>(sum);
+			}
+		};
+
+		auto edgePixel = [&](int x) {
+			for (int c = 0; c < 3; ++c)
+			{
+				int sum = 0;
+				for (int k = 0; k < size; ++k)
+				{
+					int nx = std::clamp(x - radius + k, 0, static_cast<int>(width) - 1);
+					sum += weights[k] * row[nx * 3 + c];
+				}
+				store((x - square.startX) * 3 + c, sum);
+			}
+		};
+
+		for (int x = square.startX; x < innerStart; ++x)
+		{
+			edgePixel(x);
+		}
+
+		const uint8_t* base = row - radius * 3;
+		int i = innerStart * 3;
+#ifdef SIMD_BLUR_X64
+		if constexpr (std::is_same_v<Sum, int16_t>)
+		{
+			i += SimdConvolution::HorizontalRow<Size, Accumulate>(base + i, out + (innerStart - square.startX) * 3,
+				(innerEnd - innerStart) * 3, weights, size);
+		}
+#endif
+		for (; i + BLOCK <= innerEnd * 3; i += BLOCK)
+		{
+			int block[BLOCK] = {};
+			for (int k = 0; k < size; ++k)
+			{
+				for (int j = 0; j < BLOCK; ++j)
+				{
+					block[j] += weights[k] * base[i + j + k * 3];
+				}
+			}
+			for (int j = 0; j < BLOCK; ++j)
+			{
+				store(i - square.startX * 3 + j, block[j]);
+			}
+		}
+		for (; i < innerEnd * 3; ++i)
+		{
+			int sum = 0;
+			for (int k = 0; k < size; ++k)
+			{
+				sum += weights[k] * base[i + k * 3];
+			}
+			store(i - square.startX * 3, sum);
+		}
+
+		for (int x = innerEnd; x < square.endX; ++x)
+		{
+			edgePixel(x);
+		}
+	}
+};
+
+// Однократная свёртка изображения на пуле потоков с распределением квадратов из BmpProcessor.
+// Для ядер 3x3, 5x5 и 7x7 используются специализации с известным размером
+class ConvolutionFilter
+{
+public:
+	static void Apply(FileData& fileData, int numThreads, const ConvolutionKernel& kernel,
+		float unsharpAmount = 0.0f, const BlurOptions& options = {})
+	{
+		WorkerPool pool(numThreads, options.pinPolicy);
+		Apply(fileData, pool, kernel, unsharpAmount, options);
+	}
+
+	// При unsharpAmount != 0 ядро считается размывающим, и результат -
+	// нерезкое маскирование: src + amount * (src - blurred)
+	static void Apply(FileData& fileData, WorkerPool& pool, const ConvolutionKernel& kernel,
+		float unsharpAmount = 0.0f, const BlurOptions& options = {})
+	{
+		uint32_t width = fileData.GetWidth();
+		uint32_t height = fileData.GetHeight();
+		uint32_t rowStride = fileData.GetRowStride();
+		auto threadSquares = BmpProcessor::DivideIntoSquares(width, height, pool.Size());
+		SquareFunction function = Select(kernel);
+		bool vectorized = false;
+#ifdef SIMD_BLUR_X64
+		vectorized = options.simdLevel != SimdLevel::Scalar && SimdConvolution::Supports(kernel);
+#endif
+		// Коэффициент в фиксированной точке 8.8
+		int amount = static_cast<int>(std::lround(unsharpAmount * 256));
+
+		// Копия сохраняет байты выравнивания строк
+		std::vector<uint8_t> result = fileData.pixels;
+		const uint8_t* src = fileData.pixels.data();
+
+		pool.Run([&](int index) {
+			ConvolutionScratch scratch;
+			for (const Square& square : threadSquares[index])
+			{
+				function(src, result.data(), square, width, height, rowStride, kernel, vectorized, scratch);
+				if (amount != 0)
+				{
+					Sharpen(src, result.data(), square, rowStride, amount);
+				}
+			}
+		});
+
+		fileData.pixels.swap(result);
+	}
+
+private:
+	using SquareFunction = void (*)(const uint8_t*, uint8_t*, const Square&, uint32_t, uint32_t, uint32_t,
+		const ConvolutionKernel&, bool, ConvolutionScratch&);
+
+	template <bool Separable>
+	static SquareFunction SelectSize(int size)
+	{
+		switch (size)
+		{
+		case 3:
+			return &ConvolutionEngine<3, Separable>::ApplyToSquare;
+		case 5:
+			return &ConvolutionEngine<5, Separable>::ApplyToSquare;
+		case 7:
+			return &ConvolutionEngine<7, Separable>::ApplyToSquare;
+		default:
+			return &ConvolutionEngine<0, Separable>::ApplyToSquare;
+		}
+	}
+
+	static SquareFunction Select(const ConvolutionKernel& kernel)
+	{
+		return kernel.separable ? SelectSize<true>(kernel.size) : SelectSize<false>(kernel.size);
+	}
+
+	// blurred уже лежит в dst и заменяется результатом маскирования
+	static void Sharpen(const uint8_t* src, uint8_t* dst, const Square& square, uint32_t rowStride, int amount)
+	{
+		for (int y = square.startY; y < square.endY; ++y)
+		{
+			size_t begin = static_cast<size_t>(y) * rowStride + square.startX * 3;
+			size_t end = static_cast<size_t>(y) * rowStride + square.endX * 3;
+			for (size_t i = begin; i < end; ++i)
+			{
+				int detail = src[i] - dst[i];
+				dst[i] = static_cast<uint8_t>(std::clamp(src[i] + ((detail * amount + 128) >> 8), 0, 255));
+			}
+		}
+	}
+};
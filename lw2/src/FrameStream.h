@@ -0,0 +1,329 @@
+#pragma once
+#include "BmpProcessor.h"
+#include "BoundedQueue.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+struct FrameStreamConfig
+{
+	// Шаблон имени с номером кадра в стиле printf ("in/frame_%04d.bmp") или "-" для BMP подряд в stdin
+	std::string input;
+	std::string output;
+	int firstFrame = 0;
+	int numThreads = 1;
+	// Кадры, которые blur обрабатывает одновременно, каждый на своём пуле из numThreads / frameWorkers потоков
+	int frameWorkers = 1;
+	// Маленькие очереди держат задержку кадра ограниченной: читатель не убегает вперёд
+	size_t queueCapacity = 1;
+	BlurOptions options;
+};
+
+struct FrameStreamStats
+{
+	int frames = 0;
+	double wallMs = 0;
+	double fps = 0;
+	// Задержка кадра от поступления его заголовка до окончания записи результата
+	double latencyP50Ms = 0;
+	double latencyP95Ms = 0;
+	double latencyP99Ms = 0;
+	double latencyMaxMs = 0;
+};
+
+// Долгоживущий режим для последовательности кадров: потоки, пулы и буферы кадров создаются
+// один раз. Чтение, blur и запись идут отдельными стадиями, как в BatchProcessor, и blur
+// может вести несколько кадров сразу, а запись восстанавливает исходный порядок
+class FrameStream
+{
+public:
+	static FrameStreamStats Run(const FrameStreamConfig& config)
+	{
+		if (config.input != "-")
+		{
+			FormatName(config.input, config.firstFrame);
+		}
+		FormatName(config.output, config.firstFrame);
+
+		int workers = std::clamp(config.frameWorkers, 1, config.numThreads);
+		// Кадров в обороте хватает на обе очереди, все blur-стадии и переупорядочивание
+		int frames = static_cast<int>(2 * config.queueCapacity) + 2 * workers;
+		StreamContext context(config.queueCapacity, frames);
+		context.config = &config;
+		context.activeWorkers = workers;
+		for (int i = 0; i < frames; ++i)
+		{
+			context.free.Push(Frame{});
+		}
+
+		std::thread reader(ReadStage, &context);
+		std::vector<std::thread> blurWorkers;
+		int firstCpu = 0;
+		for (int i = 0; i < workers; ++i)
+		{
+			int threads = config.numThreads * (i + 1) / workers - config.numThreads * i / workers;
+			blurWorkers.emplace_back(BlurStage, &context, threads, firstCpu);
+			firstCpu += threads;
+		}
+
+		// Запись идёт в текущем потоке
+		WriteStage(&context);
+
+		reader.join();
+		for (std::thread& worker : blurWorkers)
+		{
+			worker.join();
+		}
+		if (!context.error.empty())
+		{
+			throw std::runtime_error(context.error);
+		}
+		return context.Summarize();
+	}
+
+	// Подставляет номер в единственный спецификатор %d или %0Nd шаблона
+	static std::string FormatName(const std::string& pattern, int index)
+	{
+		size_t percent = pattern.find('%');
+		size_t spec = pattern.find_first_not_of("0123456789", percent + 1);
+		if (percent == std::string::npos || spec == std::string::npos || pattern[spec] != 'd'
+			|| pattern.find('%', spec) != std::string::npos)
+		{
+			throw std::runtime_error("Frame name pattern must contain exactly one %d or %0Nd");
+		}
+
+		std::string number = std::to_string(index);
+		std::string width = pattern.substr(percent + 1, spec - percent - 1);
+		size_t digits = width.empty() ? 0 : std::stoul(width);
+		if (number.size() < digits)
+		{
+			number.insert(0, digits - number.size(), '0');
+		}
+		return pattern.substr(0, percent) + number + pattern.substr(spec + 1);
+	}
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	// scratch - второй буфер итераций, после первого кадра размеры буферов уже не меняются
+	struct Frame
+	{
+		int index = 0;
+		Clock::time_point arrival;
+		FileData data;
+		std::vector<uint8_t> scratch;
+	};
+
+	struct StreamContext
+	{
+		StreamContext(size_t capacity, int frames)
+			: free(frames)
+			, decoded(capacity)
+			, blurred(capacity)
+		{
+		}
+
+		FrameStreamStats Summarize()
+		{
+			FrameStreamStats stats;
+			stats.frames = static_cast<int>(latencies.size());
+			if (stats.frames == 0)
+			{
+				return stats;
+			}
+			stats.wallMs = std::chrono::duration<double, std::milli>(lastWrite - firstArrival).count();
+			stats.fps = stats.wallMs > 0 ? stats.frames * 1000.0 / stats.wallMs : 0.0;
+
+			std::ranges::sort(latencies);
+			auto percentile = [&](double percent) {
+				size_t rank = static_cast<size_t>(std::ceil(percent / 100.0 * latencies.size()));
+				return latencies[std::clamp<size_t>(rank, 1, latencies.size()) - 1];
+			};
+			stats.latencyP50Ms = percentile(50);
+			stats.latencyP95Ms = percentile(95);
+			stats.latencyP99Ms = percentile(99);
+			stats.latencyMaxMs = latencies.back();
+			return stats;
+		}
+
+		const FrameStreamConfig* config = nullptr;
+		BoundedQueue<Frame> free;
+		BoundedQueue<Frame> decoded;
+		BoundedQueue<Frame> blurred;
+		int activeWorkers = 0;
+		std::mutex mutex;
+		std::string error;
+		std::vector<double> latencies;
+		Clock::time_point firstArrival;
+		Clock::time_point lastWrite;
+	};
+
+	static void Fail(StreamContext* context, const std::string& message)
+	{
+		std::lock_guard lock(context->mutex);
+		if (context->error.empty())
+		{
+			context->error = message;
+		}
+	}
+
+	// Кадр читается в переиспользуемый буфер. false - кадров больше нет
+	static bool ReadFrame(std::istream& in, Frame& frame)
+	{
+		FileData& data = frame.data;
+		if (!in.read(reinterpret_cast<char*>(&data.header), sizeof(FileHeader)))
+		{
+			if (in.gcount() != 0)
+			{
+				throw std::runtime_error("Truncated frame header");
+			}
+			return false;
+		}
+		frame.arrival = Clock::now();
+		if (!in.read(reinterpret_cast<char*>(&data.bitmapHeader), sizeof(BitmapHeader)))
+		{
+			throw std::runtime_error("Truncated frame header");
+		}
+
+		// Размер потока заранее неизвестен, поэтому проверяется только формат
+		uint32_t rowStride = BmpProcessor::ValidateHeaders(data.header, data.bitmapHeader, std::numeric_limits<uint64_t>::max());
+		if (data.bitmapHeader.height < 0)
+		{
+			throw std::runtime_error("Top-down BMP frames are not supported");
+		}
+		in.ignore(data.header.offset_data - sizeof(FileHeader) - sizeof(BitmapHeader));
+
+		data.pixels.resize(static_cast<size_t>(rowStride) * data.GetHeight());
+		if (!in.read(reinterpret_cast<char*>(data.pixels.data()), static_cast<std::streamsize>(data.pixels.size())))
+		{
+			throw std::runtime_error("Truncated frame pixels");
+		}
+
+		// Результат пишется сразу после заголовков
+		data.header.offset_data = sizeof(FileHeader) + sizeof(BitmapHeader);
+		data.header.file_size = static_cast<uint32_t>(data.header.offset_data + data.pixels.size());
+		data.bitmapHeader.size = sizeof(BitmapHeader);
+		return true;
+	}
+
+	// Нумерованная последовательность заканчивается на первом отсутствующем файле
+	static void ReadStage(StreamContext* context)
+	{
+		const FrameStreamConfig& config = *context->config;
+		bool fromStdin = config.input == "-";
+#ifdef _WIN32
+		if (fromStdin)
+		{
+			_setmode(_fileno(stdin), _O_BINARY);
+		}
+#endif
+
+		try
+		{
+			for (int index = config.firstFrame;; ++index)
+			{
+				std::ifstream file;
+				if (!fromStdin)
+				{
+					file.open(FormatName(config.input, index), std::ios::binary);
+					if (!file)
+					{
+						break;
+					}
+				}
+
+				auto frame = context->free.Pop();
+				frame->index = index;
+				if (!ReadFrame(fromStdin ? std::cin : file, *frame))
+				{
+					break;
+				}
+				context->decoded.Push(std::move(*frame));
+			}
+		}
+		catch (const std::exception& e)
+		{
+			Fail(context, e.what());
+		}
+		context->decoded.Close();
+	}
+
+	static void BlurStage(StreamContext* context, int numThreads, int firstCpu)
+	{
+		const BlurOptions& options = context->config->options;
+		WorkerPool pool(numThreads, options.pinPolicy, firstCpu);
+		while (auto frame = context->decoded.Pop())
+		{
+			FileData& data = frame->data;
+			frame->scratch.resize(data.pixels.size());
+			BmpProcessor::BlurPixels(data.pixels.data(), frame->scratch.data(), data.pixels.data(),
+				data.GetWidth(), data.GetHeight(), data.GetRowStride(), pool, options);
+			// При нечётном числе итераций результат во втором буфере
+			if (BmpProcessor::ITERATIONS % 2 == 1)
+			{
+				data.pixels.swap(frame->scratch);
+			}
+			context->blurred.Push(std::move(*frame));
+		}
+
+		// Последняя blur-стадия закрывает очередь записи
+		std::lock_guard lock(context->mutex);
+		if (--context->activeWorkers == 0)
+		{
+			context->blurred.Close();
+		}
+	}
+
+	// Кадры от нескольких blur-стадий приходят не по порядку и ждут своей очереди
+	static void WriteStage(StreamContext* context)
+	{
+		const FrameStreamConfig& config = *context->config;
+		std::map<int, Frame> pending;
+		int next = config.firstFrame;
+
+		while (auto frame = context->blurred.Pop())
+		{
+			pending.emplace(frame->index, std::move(*frame));
+			for (auto it = pending.find(next); it != pending.end(); it = pending.find(++next))
+			{
+				Frame& ready = it->second;
+				try
+				{
+					BmpProcessor::Write(FormatName(config.output, ready.index), ready.data);
+				}
+				catch (const std::exception& e)
+				{
+					Fail(context, e.what());
+				}
+
+				auto now = Clock::now();
+				if (context->latencies.empty())
+				{
+					context->firstArrival = ready.arrival;
+				}
+				context->lastWrite = now;
+				context->latencies.push_back(std::chrono::duration<double, std::milli>(now - ready.arrival).count());
+
+				context->free.Push(std::move(ready));
+				pending.erase(it);
+			}
+		}
+	}
+};
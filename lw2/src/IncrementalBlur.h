@@ -0,0 +1,280 @@
+#pragma once
+#include "BmpProcessor.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+struct IncrementalStats
+{
+	bool full;
+	int dirtyTiles;
+	int totalTiles;
+	// Доля пикселей, пересчитанных на первой, самой широкой итерации
+	double recomputedShare;
+	double diffMs;
+	double blurMs;
+};
+
+// Повторный blur изображения, которое немного отличается от предыдущего. Результат пикселя
+// зависит только от входа в пределах ITERATIONS * radius, поэтому пересчитываются плитки,
+// изменившиеся с прошлого вызова, расширенные на это расстояние, а остальное берётся из кэша.
+// Как полосы с ореолом в StreamingBlur, итерация k считает область, расширенную ещё на
+// (ITERATIONS - k) * radius, так что промежуточные буферы прошлых вызовов не нужны
+class IncrementalBlur
+{
+public:
+	static constexpr int TILE_SIZE = 64;
+	// Если пересчитывать пришлось бы больше этой доли пикселей, обычный blur дешевле
+	static constexpr double FULL_BLUR_SHARE = 0.5;
+
+	explicit IncrementalBlur(WorkerPool& pool, const BlurOptions& options = {})
+		: m_pool(pool)
+		, m_options(options)
+	{
+	}
+
+	// Предыдущий вход и результат его blur с теми же параметрами, например из файлов
+	void Seed(const FileData& input, const FileData& output)
+	{
+		if (input.GetWidth() != output.GetWidth() || input.GetHeight() != output.GetHeight()
+			|| input.pixels.size() != output.pixels.size())
+		{
+			throw std::runtime_error("Previous input and output sizes differ");
+		}
+		m_width = input.GetWidth();
+		m_height = input.GetHeight();
+		m_input = input.pixels;
+		m_output = output.pixels;
+	}
+
+	// Заменяет пиксели fileData результатом blur и запоминает вход для следующего вызова
+	IncrementalStats Blur(FileData& fileData)
+	{
+		IncrementalStats stats{};
+		uint32_t width = fileData.GetWidth();
+		uint32_t height = fileData.GetHeight();
+		int columns = static_cast<int>((width + TILE_SIZE - 1) / TILE_SIZE);
+		int rows = static_cast<int>((height + TILE_SIZE - 1) / TILE_SIZE);
+		stats.totalTiles = columns * rows;
+
+		if (m_input.empty() || width != m_width || height != m_height || fileData.pixels.size() != m_input.size())
+		{
+			return BlurFull(fileData, stats);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<Square> dirty = FindDirtyTiles(fileData, columns, rows, stats.dirtyTiles);
+		stats.diffMs = ElapsedMs(start);
+
+		// Первая итерация считает изменённые плитки, расширенные на влияние всех итераций
+		// плюс ореол оставшихся (ITERATIONS - 1) итераций
+		int radius = m_options.radius;
+		std::vector<std::vector<Square>> regions(BmpProcessor::ITERATIONS);
+		for (int iter = 1; iter <= BmpProcessor::ITERATIONS; ++iter)
+		{
+			regions[iter - 1] = CoverRegion(dirty, (2 * BmpProcessor::ITERATIONS - iter) * radius);
+		}
+
+		uint64_t area = 0;
+		for (const Square& region : regions.front())
+		{
+			area += static_cast<uint64_t>(region.endX - region.startX) * (region.endY - region.startY);
+		}
+		stats.recomputedShare = static_cast<double>(area) / (static_cast<double>(width) * height);
+		if (stats.recomputedShare > FULL_BLUR_SHARE)
+		{
+			return BlurFull(fileData, stats);
+		}
+
+		start = std::chrono::steady_clock::now();
+		if (!dirty.empty())
+		{
+			BlurRegions(fileData, regions);
+			for (const Square& tile : dirty)
+			{
+				CopyRect(fileData.pixels.data(), m_input.data(), tile, fileData.GetRowStride());
+			}
+		}
+		std::ranges::copy(m_output, fileData.pixels.begin());
+		stats.blurMs = ElapsedMs(start);
+		return stats;
+	}
+
+private:
+	static double ElapsedMs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	IncrementalStats BlurFull(FileData& fileData, IncrementalStats& stats)
+	{
+		auto start = std::chrono::steady_clock::now();
+		m_width = fileData.GetWidth();
+		m_height = fileData.GetHeight();
+		m_input = fileData.pixels;
+		BmpProcessor::BlurImage(fileData, m_pool, m_options);
+		m_output = fileData.pixels;
+
+		stats.full = true;
+		stats.dirtyTiles = stats.totalTiles;
+		stats.recomputedShare = 1.0;
+		stats.blurMs = ElapsedMs(start);
+		return stats;
+	}
+
+	// Сравнивает вход с предыдущим по плиткам, строки плиток делятся между потоками.
+	// Соседние изменённые плитки одной строки объединяются в один прямоугольник
+	std::vector<Square> FindDirtyTiles(const FileData& fileData, int columns, int rows, int& dirtyTiles) const
+	{
+		uint32_t rowStride = fileData.GetRowStride();
+		std::vector<uint8_t> changed(static_cast<size_t>(columns) * rows, 0);
+		int numThreads = m_pool.Size();
+
+		m_pool.Run([&](int index) {
+			for (int tileY = rows * index / numThreads; tileY < rows * (index + 1) / numThreads; ++tileY)
+			{
+				int endY = std::min((tileY + 1) * TILE_SIZE, static_cast<int>(m_height));
+				for (int tileX = 0; tileX < columns; ++tileX)
+				{
+					size_t begin = static_cast<size_t>(tileX) * TILE_SIZE * 3;
+					size_t bytes = static_cast<size_t>(std::min((tileX + 1) * TILE_SIZE, static_cast<int>(m_width))) * 3 - begin;
+					for (int y = tileY * TILE_SIZE; y < endY; ++y)
+					{
+						size_t offset = static_cast<size_t>(y) * rowStride + begin;
+						if (std::memcmp(fileData.pixels.data() + offset, m_input.data() + offset, bytes) != 0)
+						{
+							changed[static_cast<size_t>(tileY) * columns + tileX] = 1;
+							break;
+						}
+					}
+				}
+			}
+		});
+
+		std::vector<Square> dirty;
+		dirtyTiles = 0;
+		for (int tileY = 0; tileY < rows; ++tileY)
+		{
+			for (int tileX = 0; tileX < columns; ++tileX)
+			{
+				if (!changed[static_cast<size_t>(tileY) * columns + tileX])
+				{
+					continue;
+				}
+				++dirtyTiles;
+				bool extends = tileX > 0 && changed[static_cast<size_t>(tileY) * columns + tileX - 1];
+				int endX = std::min((tileX + 1) * TILE_SIZE, static_cast<int>(m_width));
+				if (extends)
+				{
+					dirty.back().endX = endX;
+				}
+				else
+				{
+					dirty.push_back({ tileX * TILE_SIZE, tileY * TILE_SIZE, endX, std::min((tileY + 1) * TILE_SIZE, static_cast<int>(m_height)) });
+				}
+			}
+		}
+		return dirty;
+	}
+
+	// Объединение прямоугольников, расширенных на margin, в виде непересекающихся
+	// прямоугольников, чтобы потоки не писали один пиксель дважды
+	std::vector<Square> CoverRegion(const std::vector<Square>& rects, int margin) const
+	{
+		std::vector<Square> grown;
+		std::vector<int> edges;
+		for (const Square& rect : rects)
+		{
+			grown.push_back({ std::max(rect.startX - margin, 0), std::max(rect.startY - margin, 0),
+				std::min(rect.endX + margin, static_cast<int>(m_width)), std::min(rect.endY + margin, static_cast<int>(m_height)) });
+			edges.push_back(grown.back().startY);
+			edges.push_back(grown.back().endY);
+		}
+		std::ranges::sort(edges);
+		edges.erase(std::ranges::unique(edges).begin(), edges.end());
+
+		std::vector<Square> cover;
+		for (size_t i = 0; i + 1 < edges.size(); ++i)
+		{
+			std::vector<std::pair<int, int>> spans;
+			for (const Square& rect : grown)
+			{
+				if (rect.startY <= edges[i] && rect.endY >= edges[i + 1])
+				{
+					spans.emplace_back(rect.startX, rect.endX);
+				}
+			}
+			std::ranges::sort(spans);
+			for (size_t j = 0; j < spans.size(); ++j)
+			{
+				auto [startX, endX] = spans[j];
+				while (j + 1 < spans.size() && spans[j + 1].first <= endX)
+				{
+					endX = std::max(endX, spans[++j].second);
+				}
+				cover.push_back({ startX, edges[i], endX, edges[i + 1] });
+			}
+		}
+		return cover;
+	}
+
+	// Все итерации над regions: первая читает новый вход, последняя пишет прямо в кэш результата.
+	// Строки каждого прямоугольника делятся между потоками
+	void BlurRegions(const FileData& fileData, const std::vector<std::vector<Square>>& regions)
+	{
+		m_first.resize(m_output.size());
+		m_second.resize(m_output.size());
+		int numThreads = m_pool.Size();
+
+		m_pool.Run([&](int index) {
+			ThreadData data{};
+			data.srcPixels = fileData.pixels.data();
+			data.width = m_width;
+			data.height = m_height;
+			data.rowStride = fileData.GetRowStride();
+			data.radius = m_options.radius;
+			data.simdLevel = m_options.simdLevel;
+
+			for (int iter = 1; iter <= BmpProcessor::ITERATIONS; ++iter)
+			{
+				data.dstPixels = iter == BmpProcessor::ITERATIONS ? m_output.data()
+					: iter % 2 == 1 ? m_first.data() : m_second.data();
+				for (const Square& region : regions[iter - 1])
+				{
+					int regionRows = region.endY - region.startY;
+					Square slice{ region.startX, region.startY + regionRows * index / numThreads,
+						region.endX, region.startY + regionRows * (index + 1) / numThreads };
+					if (slice.startY < slice.endY)
+					{
+						BmpProcessor::BlurSquare(data, slice);
+					}
+				}
+				data.srcPixels = data.dstPixels;
+				m_pool.Barrier();
+			}
+		});
+	}
+
+	static void CopyRect(const uint8_t* src, uint8_t* dst, const Square& rect, uint32_t rowStride)
+	{
+		for (int y = rect.startY; y < rect.endY; ++y)
+		{
+			size_t offset = static_cast<size_t>(y) * rowStride + rect.startX * 3;
+			std::copy_n(src + offset, (rect.endX - rect.startX) * 3, dst + offset);
+		}
+	}
+
+	WorkerPool& m_pool;
+	BlurOptions m_options;
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	std::vector<uint8_t> m_input;
+	std::vector<uint8_t> m_output;
+	std::vector<uint8_t> m_first;
+	std::vector<uint8_t> m_second;
+};
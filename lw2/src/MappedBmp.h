@@ -0,0 +1,269 @@
+#pragma once
+#include "BmpProcessor.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Файл, отображённый в память целиком
+class MappedFile
+{
+public:
+	MappedFile() = default;
+
+	MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+
+	MappedFile& operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Close();
+			std::swap(m_data, other.m_data);
+			std::swap(m_size, other.m_size);
+#ifdef _WIN32
+			std::swap(m_file, other.m_file);
+			std::swap(m_mapping, other.m_mapping);
+#else
+			std::swap(m_fd, other.m_fd);
+#endif
+		}
+		return *this;
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile() { Close(); }
+
+	uint8_t* Data() const { return m_data; }
+	size_t Size() const { return m_size; }
+
+	static MappedFile OpenRead(const std::string& filename)
+	{
+		MappedFile result;
+#ifdef _WIN32
+		result.m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		LARGE_INTEGER size{};
+		if (result.m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(result.m_file, &size))
+		{
+			throw std::runtime_error("Cannot open file");
+		}
+		result.m_size = static_cast<size_t>(size.QuadPart);
+		result.Map(PAGE_READONLY, FILE_MAP_READ);
+#else
+		result.m_fd = open(filename.c_str(), O_RDONLY);
+		struct stat info{};
+		if (result.m_fd < 0 || fstat(result.m_fd, &info) != 0)
+		{
+			throw std::runtime_error("Cannot open file");
+		}
+		result.m_size = static_cast<size_t>(info.st_size);
+		result.Map(PROT_READ, MAP_PRIVATE);
+#endif
+		return result;
+	}
+
+	// Создаёт файл заданного размера, заполненный нулями
+	static MappedFile Create(const std::string& filename, size_t size)
+	{
+		MappedFile result;
+		result.m_size = size;
+#ifdef _WIN32
+		result.m_file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+			FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (result.m_file == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error("Cannot create file");
+		}
+		result.Map(PAGE_READWRITE, FILE_MAP_WRITE);
+#else
+		result.m_fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (result.m_fd < 0 || ftruncate(result.m_fd, static_cast<off_t>(size)) != 0)
+		{
+			throw std::runtime_error("Cannot create file");
+		}
+		result.Map(PROT_READ | PROT_WRITE, MAP_SHARED);
+#endif
+		return result;
+	}
+
+private:
+#ifdef _WIN32
+	void Map(DWORD protection, DWORD access)
+	{
+		if (m_size == 0)
+		{
+			throw std::runtime_error("Cannot map empty file");
+		}
+
+		// Для файла на запись отображение такого размера заодно растягивает файл
+		auto size = static_cast<uint64_t>(m_size);
+		m_mapping = CreateFileMappingA(m_file, nullptr, protection, static_cast<DWORD>(size >> 32),
+			static_cast<DWORD>(size), nullptr);
+		if (m_mapping == nullptr)
+		{
+			throw std::runtime_error("Cannot map file");
+		}
+
+		m_data = static_cast<uint8_t*>(MapViewOfFile(m_mapping, access, 0, 0, m_size));
+		if (m_data == nullptr)
+		{
+			throw std::runtime_error("Cannot map file");
+		}
+	}
+#else
+	void Map(int protection, int flags)
+	{
+		if (m_size == 0)
+		{
+			throw std::runtime_error("Cannot map empty file");
+		}
+
+		// MAP_POPULATE заранее подгружает страницы, чтобы потоки blur не ловили page fault
+		void* data = mmap(nullptr, m_size, protection, flags | MAP_POPULATE, m_fd, 0);
+		if (data == MAP_FAILED)
+		{
+			throw std::runtime_error("Cannot map file");
+		}
+		m_data = static_cast<uint8_t*>(data);
+		madvise(m_data, m_size, MADV_WILLNEED);
+	}
+#endif
+
+	void Close()
+	{
+#ifdef _WIN32
+		if (m_data != nullptr)
+		{
+			UnmapViewOfFile(m_data);
+		}
+		if (m_mapping != nullptr)
+		{
+			CloseHandle(m_mapping);
+		}
+		if (m_file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(m_file);
+		}
+		m_mapping = nullptr;
+		m_file = INVALID_HANDLE_VALUE;
+#else
+		if (m_data != nullptr)
+		{
+			munmap(m_data, m_size);
+		}
+		if (m_fd >= 0)
+		{
+			close(m_fd);
+		}
+		m_fd = -1;
+#endif
+		m_data = nullptr;
+		m_size = 0;
+	}
+
+	uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	HANDLE m_mapping = nullptr;
+#else
+	int m_fd = -1;
+#endif
+};
+
+struct MappedImage
+{
+	MappedFile file;
+	BitmapHeader bitmapHeader;
+	uint32_t width;
+	uint32_t height;
+	uint32_t rowStride;
+	uint8_t* pixels;
+};
+
+// BMP без промежуточного FileData: blur читает пиксели прямо из отображённого входного файла
+// и пишет в заранее созданный отображённый выходной
+class MappedBmp
+{
+public:
+	static MappedImage Open(const std::string& filename)
+	{
+		MappedImage image;
+		image.file = MappedFile::OpenRead(filename);
+		size_t size = image.file.Size();
+
+		if (size < sizeof(FileHeader) + sizeof(BitmapHeader))
+		{
+			throw std::runtime_error("File is too small for BMP headers");
+		}
+
+		FileHeader header;
+		std::memcpy(&header, image.file.Data(), sizeof(FileHeader));
+		std::memcpy(&image.bitmapHeader, image.file.Data() + sizeof(FileHeader), sizeof(BitmapHeader));
+		const BitmapHeader& info = image.bitmapHeader;
+
+		uint32_t rowStride = BmpProcessor::ValidateHeaders(header, info, size);
+
+		image.width = static_cast<uint32_t>(info.width);
+		image.height = static_cast<uint32_t>(std::abs(info.height));
+		image.rowStride = rowStride;
+		image.pixels = image.file.Data() + header.offset_data;
+		return image;
+	}
+
+	// Выходной файл того же размера с пикселями сразу после заголовков
+	static MappedImage Create(const std::string& filename, const MappedImage& source)
+	{
+		size_t pixelsSize = static_cast<size_t>(source.rowStride) * source.height;
+
+		FileHeader header;
+		header.offset_data = sizeof(FileHeader) + sizeof(BitmapHeader);
+		header.file_size = static_cast<uint32_t>(header.offset_data + pixelsSize);
+
+		MappedImage image;
+		image.bitmapHeader = source.bitmapHeader;
+		image.bitmapHeader.size = sizeof(BitmapHeader);
+		image.bitmapHeader.size_image = static_cast<uint32_t>(pixelsSize);
+		image.width = source.width;
+		image.height = source.height;
+		image.rowStride = source.rowStride;
+
+		image.file = MappedFile::Create(filename, header.file_size);
+		std::memcpy(image.file.Data(), &header, sizeof(FileHeader));
+		std::memcpy(image.file.Data() + sizeof(FileHeader), &image.bitmapHeader, sizeof(BitmapHeader));
+		image.pixels = image.file.Data() + header.offset_data;
+		return image;
+	}
+
+	static BlurStats BlurFile(const std::string& inputFile, const std::string& outputFile, int numThreads,
+		const BlurOptions& options = {})
+	{
+		MappedImage input = Open(inputFile);
+		MappedImage output = Create(outputFile, input);
+		std::vector<uint8_t> scratch(static_cast<size_t>(input.rowStride) * input.height);
+
+		// Последняя итерация должна писать прямо в выходной файл
+		bool oddIterations = BmpProcessor::ITERATIONS % 2 == 1;
+		uint8_t* first = oddIterations ? output.pixels : scratch.data();
+		uint8_t* second = oddIterations ? scratch.data() : output.pixels;
+
+		WorkerPool pool(numThreads, options.pinPolicy);
+		return BmpProcessor::BlurPixels(input.pixels, first, second,
+			input.width, input.height, input.rowStride, pool, options);
+	}
+};
@@ -0,0 +1,200 @@
+#pragma once
+#include "BmpProcessor.h"
+#include "SimdBlur.h"
+#include "WorkerPool.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+// Изображение в плоском формате: каналы B, G и R лежат отдельными плоскостями.
+// Начало каждой строки выровнено по кэш-линии, байты после width до pitch не используются
+class PlanarImage
+{
+public:
+	static constexpr size_t ALIGNMENT = 64;
+	static constexpr int CHANNELS = 3;
+
+	PlanarImage(uint32_t width, uint32_t height)
+		: m_width(width)
+		, m_height(height)
+		, m_pitch(static_cast<uint32_t>((width + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT))
+		, m_data(static_cast<uint8_t*>(::operator new[](PlaneSize() * CHANNELS, std::align_val_t{ ALIGNMENT })))
+	{
+	}
+
+	uint32_t GetWidth() const { return m_width; }
+	uint32_t GetHeight() const { return m_height; }
+	uint32_t GetPitch() const { return m_pitch; }
+
+	uint8_t* Row(int channel, uint32_t y) { return m_data.get() + channel * PlaneSize() + static_cast<size_t>(y) * m_pitch; }
+	const uint8_t* Row(int channel, uint32_t y) const { return m_data.get() + channel * PlaneSize() + static_cast<size_t>(y) * m_pitch; }
+
+	// Переставляет строки [startY, endY) из BGR в плоскости и обратно
+	void FromInterleaved(const FileData& fileData, uint32_t startY, uint32_t endY)
+	{
+		uint32_t rowStride = fileData.GetRowStride();
+		for (uint32_t y = startY; y < endY; ++y)
+		{
+			const uint8_t* src = fileData.pixels.data() + static_cast<size_t>(y) * rowStride;
+			uint8_t* b = Row(0, y);
+			uint8_t* g = Row(1, y);
+			uint8_t* r = Row(2, y);
+			for (uint32_t x = 0; x < m_width; ++x)
+			{
+				b[x] = src[x * 3 + 0];
+				g[x] = src[x * 3 + 1];
+				r[x] = src[x * 3 + 2];
+			}
+		}
+	}
+
+	void ToInterleaved(FileData& fileData, uint32_t startY, uint32_t endY) const
+	{
+		uint32_t rowStride = fileData.GetRowStride();
+		for (uint32_t y = startY; y < endY; ++y)
+		{
+			uint8_t* dst = fileData.pixels.data() + static_cast<size_t>(y) * rowStride;
+			const uint8_t* b = Row(0, y);
+			const uint8_t* g = Row(1, y);
+			const uint8_t* r = Row(2, y);
+			for (uint32_t x = 0; x < m_width; ++x)
+			{
+				dst[x * 3 + 0] = b[x];
+				dst[x * 3 + 1] = g[x];
+				dst[x * 3 + 2] = r[x];
+			}
+		}
+	}
+
+private:
+	struct AlignedDelete
+	{
+		void operator()(uint8_t* data) const { ::operator delete[](data, std::align_val_t{ ALIGNMENT }); }
+	};
+
+	size_t PlaneSize() const { return static_cast<size_t>(m_pitch) * m_height; }
+
+	uint32_t m_width;
+	uint32_t m_height;
+	uint32_t m_pitch;
+	std::unique_ptr<uint8_t[], AlignedDelete> m_data;
+};
+
+// Тот же box blur 3x3 с ITERATIONS итерациями, что и в BmpProcessor, но над плоскостями.
+// Каналы независимы, поэтому строки всех трёх плоскостей делятся между потоками как
+// одна последовательность из 3 * height строк
+class PlanarBlur
+{
+public:
+	static BlurStats BlurImage(FileData& fileData, int numThreads, const BlurOptions& options = {})
+	{
+		WorkerPool pool(numThreads, options.pinPolicy);
+		return BlurImage(fileData, pool, options);
+	}
+
+	static BlurStats BlurImage(FileData& fileData, WorkerPool& pool, const BlurOptions& options = {})
+	{
+		uint32_t width = fileData.GetWidth();
+		uint32_t height = fileData.GetHeight();
+		int numThreads = pool.Size();
+
+		BlurStats stats{};
+		stats.iterations = BmpProcessor::ITERATIONS;
+		stats.threadStartMs = pool.GetStartupMs();
+		stats.bufferCopies = 2;
+
+		PlanarImage first(width, height);
+		PlanarImage second(width, height);
+
+		auto rowsOf = [&](int index) {
+			return std::pair{ static_cast<uint64_t>(height) * index / numThreads, static_cast<uint64_t>(height) * (index + 1) / numThreads };
+		};
+
+		auto copyStart = std::chrono::steady_clock::now();
+		pool.Run([&](int index) {
+			auto [startY, endY] = rowsOf(index);
+			first.FromInterleaved(fileData, static_cast<uint32_t>(startY), static_cast<uint32_t>(endY));
+		});
+		stats.bufferCopyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - copyStart).count();
+
+		uint64_t totalRows = static_cast<uint64_t>(height) * PlanarImage::CHANNELS;
+		pool.Run([&](int index) {
+			PlanarImage* src = &first;
+			PlanarImage* dst = &second;
+			uint64_t begin = totalRows * index / numThreads;
+			uint64_t end = totalRows * (index + 1) / numThreads;
+
+			for (int iter = 0; iter < BmpProcessor::ITERATIONS; ++iter)
+			{
+				for (uint64_t row = begin; row < end; ++row)
+				{
+					BlurPlaneRow(*src, *dst, static_cast<int>(row / height), static_cast<uint32_t>(row % height), options.simdLevel);
+				}
+				std::swap(src, dst);
+				pool.Barrier();
+			}
+		});
+
+		const PlanarImage& result = BmpProcessor::ITERATIONS % 2 == 1 ? second : first;
+		copyStart = std::chrono::steady_clock::now();
+		pool.Run([&](int index) {
+			auto [startY, endY] = rowsOf(index);
+			result.ToInterleaved(fileData, static_cast<uint32_t>(startY), static_cast<uint32_t>(endY));
+		});
+		stats.bufferCopyMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - copyStart).count();
+
+		return stats;
+	}
+
+private:
+	// Внутренние пиксели строки считает векторное ядро с шагом 1 байт, края - BlurPlanePixel
+	static void BlurPlaneRow(const PlanarImage& src, PlanarImage& dst, int channel, uint32_t y, SimdLevel simdLevel)
+	{
+		uint32_t width = src.GetWidth();
+		uint32_t height = src.GetHeight();
+		uint8_t* out = dst.Row(channel, y);
+
+		if (y == 0 || y == height - 1 || width < 3)
+		{
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				out[x] = BlurPlanePixel(src, channel, x, y);
+			}
+			return;
+		}
+
+		out[0] = BlurPlanePixel(src, channel, 0, y);
+		out[width - 1] = BlurPlanePixel(src, channel, width - 1, y);
+		SimdBlur::BlurInteriorRow(simdLevel, src.Row(channel, y - 1), src.Row(channel, y), src.Row(channel, y + 1),
+			out, 1, static_cast<int>(width) - 1, 1);
+	}
+
+	// Среднее по соседям внутри изображения, как в BmpProcessor::ApplyBoxBlurToSquare
+	static uint8_t BlurPlanePixel(const PlanarImage& src, int channel, uint32_t x, uint32_t y)
+	{
+		int sum = 0;
+		int count = 0;
+		for (int dy = -1; dy <= 1; ++dy)
+		{
+			int ny = static_cast<int>(y) + dy;
+			if (ny < 0 || ny >= static_cast<int>(src.GetHeight()))
+			{
+				continue;
+			}
+			const uint8_t* row = src.Row(channel, ny);
+			for (int dx = -1; dx <= 1; ++dx)
+			{
+				int nx = static_cast<int>(x) + dx;
+				if (nx >= 0 && nx < static_cast<int>(src.GetWidth()))
+				{
+					sum += row[nx];
+					++count;
+				}
+			}
+		}
+		return static_cast<uint8_t>(sum / count);
+	}
+};
@@ -0,0 +1,358 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Логический CPU: core и package - плотные номера физического ядра и сокета,
+// у SMT-соседей одинаковый core
+struct LogicalCpu
+{
+	int id;
+	int core;
+	int package;
+	int node;
+};
+
+enum class PinPolicy
+{
+	None,
+	// Потоки заполняют ядра подряд, вместе с SMT-соседями, узел за узлом
+	Compact,
+	// Потоки раскладываются по NUMA-узлам и физическим ядрам, SMT-соседи - в последнюю очередь
+	Scatter,
+};
+
+class CpuTopology
+{
+public:
+	// Топология читается один раз за процесс
+	static const CpuTopology& Get()
+	{
+		static const CpuTopology topology = Detect();
+		return topology;
+	}
+
+	const std::vector<LogicalCpu>& GetCpus() const { return m_cpus; }
+	int GetCoreCount() const { return m_cores; }
+	int GetNodeCount() const { return m_nodes; }
+
+	// Номера логических CPU в порядке, в котором их занимают потоки
+	std::vector<int> Order(PinPolicy policy) const
+	{
+		std::vector<LogicalCpu> cpus = m_cpus;
+		std::ranges::sort(cpus, [](const LogicalCpu& a, const LogicalCpu& b) {
+			return std::tie(a.node, a.package, a.core, a.id) < std::tie(b.node, b.package, b.core, b.id);
+		});
+
+		if (policy == PinPolicy::None)
+		{
+			std::ranges::sort(cpus, {}, &LogicalCpu::id);
+		}
+		else if (policy == PinPolicy::Scatter)
+		{
+			// Ранг ядра внутри узла и ранг CPU внутри ядра
+			std::map<int, std::pair<int, int>> ranks;
+			for (size_t i = 0; i < cpus.size(); ++i)
+			{
+				bool newNode = i == 0 || cpus[i].node != cpus[i - 1].node;
+				bool newCore = newNode || cpus[i].core != cpus[i - 1].core;
+				int coreRank = newNode ? 0 : ranks[cpus[i - 1].id].first + (newCore ? 1 : 0);
+				int smtRank = newCore ? 0 : ranks[cpus[i - 1].id].second + 1;
+				ranks[cpus[i].id] = { coreRank, smtRank };
+			}
+			std::ranges::stable_sort(cpus, [&](const LogicalCpu& a, const LogicalCpu& b) {
+				const auto& [aCore, aSmt] = ranks[a.id];
+				const auto& [bCore, bSmt] = ranks[b.id];
+				return std::tie(aSmt, aCore, a.node) < std::tie(bSmt, bCore, b.node);
+			});
+		}
+
+		std::vector<int> order;
+		for (const LogicalCpu& cpu : cpus)
+		{
+			order.push_back(cpu.id);
+		}
+		return order;
+	}
+
+private:
+	static CpuTopology Detect()
+	{
+		CpuTopology topology;
+#ifdef _WIN32
+		// Без групп процессоров, то есть до 64 логических CPU
+		DWORD length = 0;
+		GetLogicalProcessorInformation(nullptr, &length);
+		std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> infos(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+		if (!infos.empty() && GetLogicalProcessorInformation(infos.data(), &length))
+		{
+			std::map<int, LogicalCpu> cpus;
+			int packages = 0;
+			for (const auto& info : infos)
+			{
+				for (int bit = 0; bit < 64; ++bit)
+				{
+					if ((info.ProcessorMask & (ULONG_PTR{ 1 } << bit)) == 0)
+					{
+						continue;
+					}
+					LogicalCpu& cpu = cpus.try_emplace(bit, LogicalCpu{ bit, -1, 0, 0 }).first->second;
+					if (info.Relationship == RelationProcessorCore)
+					{
+						cpu.core = topology.m_cores;
+					}
+					else if (info.Relationship == RelationNumaNode)
+					{
+						cpu.node = static_cast<int>(info.NumaNode.NodeNumber);
+					}
+					else if (info.Relationship == RelationProcessorPackage)
+					{
+						cpu.package = packages;
+					}
+				}
+				topology.m_cores += info.Relationship == RelationProcessorCore ? 1 : 0;
+				packages += info.Relationship == RelationProcessorPackage ? 1 : 0;
+			}
+			for (const auto& [id, cpu] : cpus)
+			{
+				if (cpu.core >= 0)
+				{
+					topology.m_cpus.push_back(cpu);
+				}
+			}
+		}
+#else
+		const std::filesystem::path cpuRoot = "/sys/devices/system/cpu";
+		std::map<std::pair<int, int>, int> cores;
+		for (int id : ParseCpuList(ReadLine(cpuRoot / "online")))
+		{
+			std::filesystem::path topologyDir = cpuRoot / ("cpu" + std::to_string(id)) / "topology";
+			int package = ReadInt(topologyDir / "physical_package_id", 0);
+			int coreId = ReadInt(topologyDir / "core_id", id);
+			int core = cores.try_emplace({ package, coreId }, static_cast<int>(cores.size())).first->second;
+			topology.m_cpus.push_back({ id, core, package, 0 });
+		}
+		topology.m_cores = static_cast<int>(cores.size());
+
+		std::error_code error;
+		for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error))
+		{
+			std::string name = entry.path().filename().string();
+			if (!name.starts_with("node") || name.find_first_not_of("0123456789", 4) != std::string::npos)
+			{
+				continue;
+			}
+			int node = std::stoi(name.substr(4));
+			for (int id : ParseCpuList(ReadLine(entry.path() / "cpulist")))
+			{
+				auto cpu = std::ranges::find(topology.m_cpus, id, &LogicalCpu::id);
+				if (cpu != topology.m_cpus.end())
+				{
+					cpu->node = node;
+				}
+			}
+		}
+#endif
+
+		// Без сведений о топологии каждый CPU считается отдельным ядром одного узла
+		if (topology.m_cpus.empty())
+		{
+			int count = std::max(1u, std::thread::hardware_concurrency());
+			for (int id = 0; id < count; ++id)
+			{
+				topology.m_cpus.push_back({ id, id, 0, 0 });
+			}
+			topology.m_cores = count;
+		}
+
+		std::vector<int> nodes;
+		for (const LogicalCpu& cpu : topology.m_cpus)
+		{
+			nodes.push_back(cpu.node);
+		}
+		std::ranges::sort(nodes);
+		topology.m_nodes = static_cast<int>(std::ranges::unique(nodes).begin() - nodes.begin());
+		return topology;
+	}
+
+#ifndef _WIN32
+	static std::string ReadLine(const std::filesystem::path& path)
+	{
+		std::ifstream in(path);
+		std::string line;
+		std::getline(in, line);
+		return line;
+	}
+
+	static int ReadInt(const std::filesystem::path& path, int fallback)
+	{
+		std::string line = ReadLine(path);
+		return line.empty() ? fallback : std::stoi(line);
+	}
+
+	// Формат списков ядра Linux: "0-3,8,10-11"
+	static std::vector<int> ParseCpuList(const std::string& list)
+	{
+		std::vector<int> ids;
+		size_t position = 0;
+		while (position < list.size())
+		{
+			size_t end = list.find(',', position);
+			std::string range = list.substr(position, end == std::string::npos ? std::string::npos : end - position);
+			size_t dash = range.find('-');
+			int first = std::stoi(range.substr(0, dash));
+			int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+			for (int id = first; id <= last; ++id)
+			{
+				ids.push_back(id);
+			}
+			position = end == std::string::npos ? list.size() : end + 1;
+		}
+		return ids;
+	}
+#endif
+
+	std::vector<LogicalCpu> m_cpus;
+	int m_cores = 0;
+	int m_nodes = 1;
+};
+
+// Привязка процесса и потоков к CPU поверх SetProcessAffinityMask или sched_setaffinity
+class Platform
+{
+public:
+	// CPU, на которых процессу разрешено выполняться
+	static std::vector<int> GetProcessCpus()
+	{
+		std::vector<int> cpus;
+#ifdef _WIN32
+		DWORD_PTR processMask = 0;
+		DWORD_PTR systemMask = 0;
+		GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask);
+		for (int bit = 0; bit < 64; ++bit)
+		{
+			if (processMask & (DWORD_PTR{ 1 } << bit))
+			{
+				cpus.push_back(bit);
+			}
+		}
+#else
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if (sched_getaffinity(0, sizeof(set), &set) == 0)
+		{
+			for (int id = 0; id < CPU_SETSIZE; ++id)
+			{
+				if (CPU_ISSET(id, &set))
+				{
+					cpus.push_back(id);
+				}
+			}
+		}
+#endif
+		return cpus;
+	}
+
+	static bool SetProcessCpus(const std::vector<int>& cpus)
+	{
+#ifdef _WIN32
+		DWORD_PTR mask = 0;
+		for (int id : cpus)
+		{
+			if (id >= 64)
+			{
+				return false;
+			}
+			mask |= DWORD_PTR{ 1 } << id;
+		}
+		return SetProcessAffinityMask(GetCurrentProcess(), mask) != 0;
+#else
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int id : cpus)
+		{
+			if (id >= CPU_SETSIZE)
+			{
+				return false;
+			}
+			CPU_SET(id, &set);
+		}
+		return sched_setaffinity(0, sizeof(set), &set) == 0;
+#endif
+	}
+
+	static bool PinCurrentThread(int cpu)
+	{
+#ifdef _WIN32
+		return cpu < 64 && SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR{ 1 } << cpu) != 0;
+#else
+		if (cpu >= CPU_SETSIZE)
+		{
+			return false;
+		}
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+	}
+
+	// CPU для потоков по политике среди разрешённых процессу. Пустой список - без привязки
+	static std::vector<int> PlanThreadCpus(PinPolicy policy)
+	{
+		if (policy == PinPolicy::None)
+		{
+			return {};
+		}
+
+		std::vector<int> allowed = GetProcessCpus();
+		std::vector<int> plan;
+		for (int id : CpuTopology::Get().Order(policy))
+		{
+			if (std::ranges::find(allowed, id) != allowed.end())
+			{
+				plan.push_back(id);
+			}
+		}
+		return plan;
+	}
+
+	// priority: 1 - выше обычного, 0 - обычный, -1 - ниже обычного.
+	// В Linux это nice потока, и повышение без CAP_SYS_NICE не сработает
+	static bool SetCurrentThreadPriority(int priority)
+	{
+#ifdef _WIN32
+		int value = priority > 0 ? THREAD_PRIORITY_ABOVE_NORMAL
+			: priority < 0 ? THREAD_PRIORITY_BELOW_NORMAL : THREAD_PRIORITY_NORMAL;
+		return SetThreadPriority(GetCurrentThread(), value) != 0;
+#else
+		auto tid = static_cast<id_t>(syscall(SYS_gettid));
+		return setpriority(PRIO_PROCESS, tid, -5 * priority) == 0;
+#endif
+	}
+
+	// Миллисекунды монотонных часов, замена timeGetTime
+	static uint32_t GetTimeMs()
+	{
+		auto now = std::chrono::steady_clock::now().time_since_epoch();
+		return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+	}
+};
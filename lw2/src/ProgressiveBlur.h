@@ -0,0 +1,159 @@
+#pragma once
+#include "BmpProcessor.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct ProgressiveStats
+{
+	int bands;
+	int bandRows;
+	// От начала blur до публикации первой полосы и до конца
+	double firstBandMs;
+	double totalMs;
+	// Во сколько раз больше строк посчитано из-за ореолов полос по сравнению с обычным blur
+	double recomputeFactor;
+};
+
+// Готовые строки результата [startRow, endRow) в порядке хранения BMP (снизу вверх),
+// rows указывает на строку startRow. Вызывается из потока, запустившего blur
+using BandCallback = std::function<void(int startRow, int endRow, const uint8_t* rows)>;
+
+// Blur с публикацией результата полосами по мере готовности, начиная с верха картинки.
+// Как в StreamingBlur, полоса считается вместе с ореолом в ITERATIONS * radius строк и после
+// всех итераций окончательна, так что первые строки готовы задолго до конца всего изображения.
+// Платой служит повторный счёт ореолов соседних полос
+class ProgressiveBlur
+{
+public:
+	static constexpr int DEFAULT_BAND_ROWS = 128;
+
+	// По окончании fileData содержит весь результат, как после BmpProcessor::BlurImage
+	static ProgressiveStats BlurImage(FileData& fileData, WorkerPool& pool, const BandCallback& onBand,
+		int bandRows = DEFAULT_BAND_ROWS, const BlurOptions& options = {})
+	{
+		if (bandRows < 1)
+		{
+			throw std::runtime_error("Band height must be positive");
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		int height = static_cast<int>(fileData.GetHeight());
+		uint32_t rowStride = fileData.GetRowStride();
+		int halo = BmpProcessor::ITERATIONS * options.radius;
+
+		// Промежуточные итерации соседних полос перекрываются, поэтому последняя итерация
+		// пишет в отдельный буфер результата, который другие полосы уже не трогают
+		std::vector<uint8_t> first(fileData.pixels.size());
+		std::vector<uint8_t> second(fileData.pixels.size());
+		std::vector<uint8_t> result = fileData.pixels;
+
+		ProgressiveStats stats{};
+		stats.bandRows = std::min(bandRows, std::max(height, 1));
+		stats.bands = (height + stats.bandRows - 1) / stats.bandRows;
+		uint64_t computedRows = 0;
+
+		for (int band = stats.bands - 1; band >= 0; --band)
+		{
+			int bandStart = band * stats.bandRows;
+			int bandEnd = std::min(height, bandStart + stats.bandRows);
+			computedRows += BlurBand(fileData, first.data(), second.data(), result.data(), pool, options, bandStart, bandEnd, halo);
+
+			if (band == stats.bands - 1)
+			{
+				stats.firstBandMs = ElapsedMs(start);
+			}
+			if (onBand)
+			{
+				onBand(bandStart, bandEnd, result.data() + static_cast<size_t>(bandStart) * rowStride);
+			}
+		}
+
+		fileData.pixels.swap(result);
+		stats.totalMs = ElapsedMs(start);
+		stats.recomputeFactor = height > 0 ? static_cast<double>(computedRows) / (static_cast<double>(height) * BmpProcessor::ITERATIONS) : 1.0;
+		return stats;
+	}
+
+	// Заголовки пишутся сразу, а каждая полоса - на своё место в файле, как только готова.
+	// Файл получается таким же, как после BmpProcessor::Write
+	static ProgressiveStats BlurToFile(FileData& fileData, const std::string& outputFile, WorkerPool& pool,
+		int bandRows = DEFAULT_BAND_ROWS, const BlurOptions& options = {})
+	{
+		std::ofstream out(outputFile, std::ios::binary);
+		if (!out)
+		{
+			throw std::runtime_error("Cannot create file");
+		}
+		out.write(reinterpret_cast<const char*>(&fileData.header), sizeof(FileHeader));
+		out.write(reinterpret_cast<const char*>(&fileData.bitmapHeader), sizeof(BitmapHeader));
+
+		uint32_t rowStride = fileData.GetRowStride();
+		ProgressiveStats stats = BlurImage(fileData, pool, [&](int startRow, int endRow, const uint8_t* rows) {
+			out.seekp(static_cast<std::streamoff>(sizeof(FileHeader) + sizeof(BitmapHeader)) + static_cast<std::streamoff>(startRow) * rowStride);
+			out.write(reinterpret_cast<const char*>(rows), static_cast<std::streamsize>(endRow - startRow) * rowStride);
+			// Строки становятся видны читателям файла сразу, а не при закрытии
+			out.flush();
+		}, bandRows, options);
+
+		if (!out)
+		{
+			throw std::runtime_error("Cannot write file");
+		}
+		return stats;
+	}
+
+private:
+	static double ElapsedMs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Итерация k считает полосу, расширенную на (ITERATIONS - k) * radius строк, строки делятся
+	// между потоками. Возвращает число посчитанных строк за все итерации
+	static uint64_t BlurBand(const FileData& fileData, uint8_t* first, uint8_t* second, uint8_t* result,
+		WorkerPool& pool, const BlurOptions& options, int bandStart, int bandEnd, int halo)
+	{
+		int height = static_cast<int>(fileData.GetHeight());
+		int numThreads = pool.Size();
+		uint64_t computedRows = 0;
+		for (int iter = 1; iter <= BmpProcessor::ITERATIONS; ++iter)
+		{
+			int margin = halo - iter * options.radius;
+			computedRows += std::min(height, bandEnd + margin) - std::max(0, bandStart - margin);
+		}
+
+		pool.Run([&](int index) {
+			ThreadData data{};
+			data.srcPixels = fileData.pixels.data();
+			data.width = fileData.GetWidth();
+			data.height = fileData.GetHeight();
+			data.rowStride = fileData.GetRowStride();
+			data.radius = options.radius;
+			data.simdLevel = options.simdLevel;
+
+			for (int iter = 1; iter <= BmpProcessor::ITERATIONS; ++iter)
+			{
+				int margin = halo - iter * options.radius;
+				int computeStart = std::max(0, bandStart - margin);
+				int rows = std::min(height, bandEnd + margin) - computeStart;
+				data.dstPixels = iter == BmpProcessor::ITERATIONS ? result : iter % 2 == 1 ? first : second;
+
+				Square slice{ 0, computeStart + rows * index / numThreads, static_cast<int>(data.width), computeStart + rows * (index + 1) / numThreads };
+				if (slice.startY < slice.endY)
+				{
+					BmpProcessor::BlurSquare(data, slice);
+				}
+				data.srcPixels = data.dstPixels;
+				pool.Barrier();
+			}
+		});
+		return computedRows;
+	}
+};
@@ -0,0 +1,468 @@
+#pragma once
+#include "BmpProcessor.h"
+#include "SimdBlur.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <vector>
+
+// Одномерное ядро, эквивалентное ITERATIONS проходам box blur 3x3 по одной оси.
+// Внутри изображения веса у всех позиций одинаковые, а у краёв зависят от позиции,
+// потому что ApplyBoxBlurToSquare делит на число соседей внутри изображения.
+// Веса хранятся в фиксированной точке, сумма весов любой позиции ровно WEIGHT_ONE
+struct AxisKernel
+{
+	static constexpr int WEIGHT_BITS = 14;
+	static constexpr int WEIGHT_ONE = 1 << WEIGHT_BITS;
+
+	int radius = 0;
+	std::vector<int16_t> interior;
+	std::vector<int> edgeIndex;
+	std::vector<int> edgeStart;
+	std::vector<std::vector<int16_t>> edgeWeights;
+
+	static AxisKernel Build(int size, int iterations)
+	{
+		AxisKernel kernel;
+		kernel.radius = iterations;
+		kernel.edgeIndex.assign(size, -1);
+
+		for (int x = 0; x < size; ++x)
+		{
+			bool isEdge = x < iterations || x >= size - iterations;
+			if (!isEdge && !kernel.interior.empty())
+			{
+				continue;
+			}
+
+			int start = std::max(0, x - iterations);
+			auto weights = Quantize(ComputeWeights(x, start, std::min(size - 1, x + iterations), size, iterations));
+			if (isEdge)
+			{
+				kernel.edgeIndex[x] = static_cast<int>(kernel.edgeWeights.size());
+				kernel.edgeStart.push_back(start);
+				kernel.edgeWeights.push_back(std::move(weights));
+			}
+			else
+			{
+				kernel.interior = std::move(weights);
+			}
+		}
+
+		return kernel;
+	}
+
+	int GetTapCount() const { return 2 * radius + 1; }
+
+	// Веса для позиции x и позиция, к которой относится первый вес
+	const std::vector<int16_t>& GetWeights(int x, int& start) const
+	{
+		if (edgeIndex[x] >= 0)
+		{
+			start = edgeStart[edgeIndex[x]];
+			return edgeWeights[edgeIndex[x]];
+		}
+		start = x - radius;
+		return interior;
+	}
+
+private:
+	// Строка матрицы M^iterations для позиции x, где M - один проход 1x3 с делением на число соседей
+	static std::vector<double> ComputeWeights(int x, int lo, int hi, int size, int iterations)
+	{
+		std::vector<double> row(hi - lo + 1, 0.0);
+		row[x - lo] = 1.0;
+
+		for (int iter = 0; iter < iterations; ++iter)
+		{
+			std::vector<double> next(row.size(), 0.0);
+			for (int i = lo; i <= hi; ++i)
+			{
+				double value = row[i - lo];
+				if (value == 0.0)
+				{
+					continue;
+				}
+
+				int count = 1 + (i > 0 ? 1 : 0) + (i < size - 1 ? 1 : 0);
+				for (int j = std::max(lo, i - 1); j <= std::min(hi, i + 1); ++j)
+				{
+					next[j - lo] += value / count;
+				}
+			}
+			row = std::move(next);
+		}
+
+		return row;
+	}
+
+	// Ошибка округления сумм переносится на наибольший вес, чтобы однотонное изображение не менялось
+	static std::vector<int16_t> Quantize(const std::vector<double>& weights)
+	{
+		std::vector<int16_t> result(weights.size());
+		int sum = 0;
+		for (size_t i = 0; i < weights.size(); ++i)
+		{
+			result[i] = static_cast<int16_t>(std::lround(weights[i] * WEIGHT_ONE));
+			sum += result[i];
+		}
+		auto largest = std::ranges::max_element(result);
+		*largest = static_cast<int16_t>(*largest + WEIGHT_ONE - sum);
+		return result;
+	}
+};
+
+// Взвешенная сумма строк: dst[i] = (sum(weights[k] * rows[k][i]) + округление) >> SHIFT
+// для i из [begin, end). Значения строк и веса неотрицательны и помещаются в int16,
+// поэтому пары соседних весов умножаются одной командой madd. У симметричного ядра строки
+// с равными весами сначала складываются, и умножений вдвое меньше, для этого сумма двух
+// значений строки тоже должна помещаться в int16
+class WeightedRowSum
+{
+public:
+	template <int SHIFT, typename Src, typename Dst>
+	static void Apply(SimdLevel level, const Src* const* rows, const int16_t* weights, int taps,
+		Dst* dst, int begin, int end)
+	{
+		bool symmetric = std::equal(weights, weights + taps / 2, std::reverse_iterator(weights + taps));
+#ifdef SIMD_BLUR_X64
+		if (level == SimdLevel::Avx2)
+		{
+			begin = ApplyAvx2<SHIFT>(rows, weights, taps, symmetric, dst, begin, end);
+		}
+		else if (level == SimdLevel::Sse2)
+		{
+			begin = ApplySse2<SHIFT>(rows, weights, taps, symmetric, dst, begin, end);
+		}
+#endif
+		ApplyScalar<SHIFT>(rows, weights, taps, symmetric, dst, begin, end);
+	}
+
+private:
+	static constexpr int SCALAR_CHUNK = 64;
+
+	// Суммы копятся по кускам строки, чтобы каждая строка читалась подряд
+	template <int SHIFT, typename Src, typename Dst>
+	static void ApplyScalar(const Src* const* rows, const int16_t* weights, int taps, bool symmetric,
+		Dst* dst, int begin, int end)
+	{
+		int count = symmetric ? taps / 2 : 0;
+		int32_t sums[SCALAR_CHUNK];
+		for (int chunk = begin; chunk < end; chunk += SCALAR_CHUNK)
+		{
+			int length = std::min(SCALAR_CHUNK, end - chunk);
+			std::fill_n(sums, length, 1 << (SHIFT - 1));
+			for (int k = 0; k < count; ++k)
+			{
+				const Src* row = rows[k] + chunk;
+				const Src* mirror = rows[taps - 1 - k] + chunk;
+				for (int j = 0; j < length; ++j)
+				{
+					sums[j] += weights[k] * (row[j] + mirror[j]);
+				}
+			}
+			for (int k = count; k < taps - count; ++k)
+			{
+				const Src* row = rows[k] + chunk;
+				for (int j = 0; j < length; ++j)
+				{
+					sums[j] += weights[k] * row[j];
+				}
+			}
+			for (int j = 0; j < length; ++j)
+			{
+				dst[chunk + j] = static_cast<Dst>(std::min<int32_t>(sums[j] >> SHIFT, std::numeric_limits<Dst>::max()));
+			}
+		}
+	}
+
+#ifdef SIMD_BLUR_X64
+	// Пара весов (k, k + 1) в одном 32-битном слове, как их ждёт madd
+	static int32_t PackWeights(const int16_t* weights, int count, int k)
+	{
+		int16_t next = k + 1 < count ? weights[k + 1] : 0;
+		return static_cast<uint16_t>(weights[k]) | (static_cast<int32_t>(next) << 16);
+	}
+
+	// Число слагаемых после сложения строк с равными весами
+	static int GetTermCount(int taps, bool symmetric) { return symmetric ? (taps + 1) / 2 : taps; }
+
+	static __m128i Load(const uint8_t* src)
+	{
+		return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src)), _mm_setzero_si128());
+	}
+	static __m128i Load(const int16_t* src)
+	{
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+	}
+	static void Store(uint8_t* dst, __m128i value)
+	{
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(value, value));
+	}
+	static void Store(int16_t* dst, __m128i value)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), value);
+	}
+
+	// Слагаемое k: строка k, а у симметричного ядра ещё и зеркальная ей строка
+	template <typename Src>
+	static __m128i LoadTerm(const Src* const* rows, int taps, int count, bool symmetric, int k, int i)
+	{
+		if (k >= count)
+		{
+			return _mm_setzero_si128();
+		}
+		__m128i value = Load(rows[k] + i);
+		return symmetric && k != taps - 1 - k ? _mm_add_epi16(value, Load(rows[taps - 1 - k] + i)) : value;
+	}
+
+	template <int SHIFT, typename Src, typename Dst>
+	static int ApplySse2(const Src* const* rows, const int16_t* weights, int taps, bool symmetric, Dst* dst, int begin, int end)
+	{
+		const __m128i round = _mm_set1_epi32(1 << (SHIFT - 1));
+		int count = GetTermCount(taps, symmetric);
+
+		int i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			__m128i lo = round;
+			__m128i hi = round;
+			for (int k = 0; k < count; k += 2)
+			{
+				__m128i a = LoadTerm(rows, taps, count, symmetric, k, i);
+				__m128i b = LoadTerm(rows, taps, count, symmetric, k + 1, i);
+				__m128i pair = _mm_set1_epi32(PackWeights(weights, count, k));
+				lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), pair));
+				hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), pair));
+			}
+			Store(dst + i, _mm_packs_epi32(_mm_srai_epi32(lo, SHIFT), _mm_srai_epi32(hi, SHIFT)));
+		}
+		return i;
+	}
+
+	SIMD_TARGET_AVX2 static __m256i Load256(const uint8_t* src)
+	{
+		return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+	}
+	SIMD_TARGET_AVX2 static __m256i Load256(const int16_t* src)
+	{
+		return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+	}
+
+	// packus работает внутри 128-битных половин, поэтому байты собираются перестановкой четвертей
+	SIMD_TARGET_AVX2 static void Store256(uint8_t* dst, __m256i value)
+	{
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(value, value), 0x08);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(packed));
+	}
+
+	SIMD_TARGET_AVX2 static void Store256(int16_t* dst, __m256i value)
+	{
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), value);
+	}
+
+	template <typename Src>
+	SIMD_TARGET_AVX2 static __m256i LoadTerm256(const Src* const* rows, int taps, int count, bool symmetric, int k, int i)
+	{
+		if (k >= count)
+		{
+			return _mm256_setzero_si256();
+		}
+		__m256i value = Load256(rows[k] + i);
+		return symmetric && k != taps - 1 - k ? _mm256_add_epi16(value, Load256(rows[taps - 1 - k] + i)) : value;
+	}
+
+	// unpack и packs работают внутри 128-битных половин, поэтому порядок элементов сохраняется
+	template <int SHIFT, typename Src, typename Dst>
+	SIMD_TARGET_AVX2 static int ApplyAvx2(const Src* const* rows, const int16_t* weights, int taps, bool symmetric,
+		Dst* dst, int begin, int end)
+	{
+		const __m256i round = _mm256_set1_epi32(1 << (SHIFT - 1));
+		int count = GetTermCount(taps, symmetric);
+
+		int i = begin;
+		for (; i + 16 <= end; i += 16)
+		{
+			__m256i lo = round;
+			__m256i hi = round;
+			for (int k = 0; k < count; k += 2)
+			{
+				__m256i a = LoadTerm256(rows, taps, count, symmetric, k, i);
+				__m256i b = LoadTerm256(rows, taps, count, symmetric, k + 1, i);
+				__m256i pair = _mm256_set1_epi32(PackWeights(weights, count, k));
+				lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), pair));
+				hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), pair));
+			}
+			Store256(dst + i, _mm256_packs_epi32(_mm256_srai_epi32(lo, SHIFT), _mm256_srai_epi32(hi, SHIFT)));
+		}
+		return ApplySse2<SHIFT>(rows, weights, taps, symmetric, dst, i, end);
+	}
+#endif
+};
+
+struct ImageDiff
+{
+	int maxDiff;
+	double meanDiff;
+	size_t differentBytes;
+};
+
+struct SeparablePassData
+{
+	const std::vector<uint8_t>* pixels;
+	std::vector<int16_t>* temp;
+	std::vector<uint8_t>* output;
+	const AxisKernel* kernel;
+	uint32_t width;
+	uint32_t height;
+	uint32_t rowStride;
+	SimdLevel simdLevel;
+	std::vector<Square> squares;
+};
+
+// Заменяет ITERATIONS проходов box blur одним горизонтальным и одним вертикальным проходом.
+// Проходы 3x3 сепарабельны, а горизонтальные и вертикальные проходы перестановочны,
+// поэтому результат совпадает с итеративным с точностью до округления: итеративный вариант
+// отбрасывает дробную часть на каждом проходе, а здесь округление одно.
+// Оба прохода идут по строкам: строка результата - взвешенная сумма целых строк источника,
+// промежуточный буфер хранит int16 с TEMP_FRACTION_BITS дробными битами
+class SeparableBlur
+{
+public:
+	// 255 << 6 вдвое меньше INT16_MAX, поэтому сумму зеркальных строк буфера можно держать в int16
+	static constexpr int TEMP_FRACTION_BITS = 6;
+
+	static void BlurImage(FileData& fileData, int numThreads, const BlurOptions& options = {})
+	{
+		uint32_t width = fileData.GetWidth();
+		uint32_t height = fileData.GetHeight();
+
+		AxisKernel horizontal = AxisKernel::Build(width, BmpProcessor::ITERATIONS);
+		AxisKernel vertical = AxisKernel::Build(height, BmpProcessor::ITERATIONS);
+		std::vector<int16_t> temp(static_cast<size_t>(width) * height * 3);
+
+		auto threadSquares = BmpProcessor::DivideIntoSquares(width, height, numThreads);
+
+		std::vector<SeparablePassData> passData(numThreads);
+		for (int i = 0; i < numThreads; ++i)
+		{
+			passData[i].pixels = &fileData.pixels;
+			passData[i].temp = &temp;
+			passData[i].output = &fileData.pixels;
+			passData[i].width = width;
+			passData[i].height = height;
+			passData[i].rowStride = fileData.GetRowStride();
+			passData[i].simdLevel = options.simdLevel;
+			passData[i].squares = threadSquares[i];
+		}
+
+		// Горизонтальный проход пишет во временный буфер, вертикальный - обратно в пиксели
+		WorkerPool pool(numThreads, options.pinPolicy);
+		pool.Run([&](int index) {
+			passData[index].kernel = &horizontal;
+			HorizontalFunction(passData[index]);
+			pool.Barrier();
+			passData[index].kernel = &vertical;
+			VerticalFunction(passData[index]);
+		});
+	}
+
+	static ImageDiff Compare(const FileData& expected, const FileData& actual)
+	{
+		ImageDiff diff{ 0, 0.0, 0 };
+		uint32_t rowStride = expected.GetRowStride();
+		size_t total = 0;
+		double sum = 0;
+
+		for (uint32_t y = 0; y < expected.GetHeight(); ++y)
+		{
+			for (uint32_t i = 0; i < expected.GetWidth() * 3; ++i)
+			{
+				int delta = std::abs(expected.pixels[y * rowStride + i] - actual.pixels[y * rowStride + i]);
+				diff.maxDiff = std::max(diff.maxDiff, delta);
+				diff.differentBytes += delta != 0 ? 1 : 0;
+				sum += delta;
+				++total;
+			}
+		}
+
+		diff.meanDiff = total > 0 ? sum / total : 0.0;
+		return diff;
+	}
+
+private:
+	static constexpr int HORIZONTAL_SHIFT = AxisKernel::WEIGHT_BITS - TEMP_FRACTION_BITS;
+	static constexpr int VERTICAL_SHIFT = AxisKernel::WEIGHT_BITS + TEMP_FRACTION_BITS;
+
+	// Для BGR сосед по горизонтали находится через 3 байта, поэтому внутренняя часть строки -
+	// сумма той же строки, сдвинутой на 3 * k байт. Крайние пиксели считаются поштучно
+	static void HorizontalFunction(const SeparablePassData& data)
+	{
+		const AxisKernel& kernel = *data.kernel;
+		int width = static_cast<int>(data.width);
+		std::vector<const uint8_t*> rows(kernel.GetTapCount());
+
+		for (const Square& square : data.squares)
+		{
+			int interiorBegin = std::clamp(kernel.radius, square.startX, square.endX);
+			int interiorEnd = std::clamp(width - kernel.radius, interiorBegin, square.endX);
+
+			for (int y = square.startY; y < square.endY; ++y)
+			{
+				const uint8_t* row = data.pixels->data() + static_cast<size_t>(y) * data.rowStride;
+				int16_t* dst = data.temp->data() + static_cast<size_t>(y) * width * 3;
+
+				auto applyAt = [&](int x, int count) {
+					int start = 0;
+					const std::vector<int16_t>& weights = kernel.GetWeights(x, start);
+					for (size_t k = 0; k < weights.size(); ++k)
+					{
+						rows[k] = row + (start + static_cast<int>(k)) * 3;
+					}
+					WeightedRowSum::Apply<HORIZONTAL_SHIFT>(data.simdLevel, rows.data(), weights.data(),
+						static_cast<int>(weights.size()), dst + x * 3, 0, count * 3);
+				};
+
+				for (int x = square.startX; x < interiorBegin; ++x)
+				{
+					applyAt(x, 1);
+				}
+				if (interiorBegin < interiorEnd)
+				{
+					applyAt(interiorBegin, interiorEnd - interiorBegin);
+				}
+				for (int x = interiorEnd; x < square.endX; ++x)
+				{
+					applyAt(x, 1);
+				}
+			}
+		}
+	}
+
+	// Строка результата - сумма соседних строк буфера, веса зависят только от y
+	static void VerticalFunction(const SeparablePassData& data)
+	{
+		const AxisKernel& kernel = *data.kernel;
+		size_t tempStride = static_cast<size_t>(data.width) * 3;
+		std::vector<const int16_t*> rows(kernel.GetTapCount());
+
+		for (const Square& square : data.squares)
+		{
+			for (int y = square.startY; y < square.endY; ++y)
+			{
+				int start = 0;
+				const std::vector<int16_t>& weights = kernel.GetWeights(y, start);
+				for (size_t k = 0; k < weights.size(); ++k)
+				{
+					rows[k] = data.temp->data() + (start + k) * tempStride;
+				}
+				WeightedRowSum::Apply<VERTICAL_SHIFT>(data.simdLevel, rows.data(), weights.data(), static_cast<int>(weights.size()),
+					data.output->data() + static_cast<size_t>(y) * data.rowStride, square.startX * 3, square.endX * 3);
+			}
+		}
+	}
+};
@@ -0,0 +1,153 @@
+#pragma once
+#include <cstdint>
+#include <initializer_list>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SIMD_BLUR_X64
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SIMD_TARGET_AVX2
+#else
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+enum class SimdLevel
+{
+	Scalar,
+	Sse2,
+	Avx2,
+};
+
+// Ядро 3x3 для внутренних пикселей изображения, где все 9 соседей существуют.
+// BGR чередуются, поэтому сосед по горизонтали для любого канала находится через 3 байта,
+// и строку можно обрабатывать как массив байтов без учёта каналов. В плоском формате
+// каждый канал лежит отдельно, и сосед находится через 1 байт
+class SimdBlur
+{
+public:
+	static SimdLevel DetectLevel()
+	{
+#ifdef SIMD_BLUR_X64
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] >= 7)
+		{
+			__cpuid(info, 1);
+			bool osUsesXsave = (info[2] & (1 << 27)) != 0;
+			bool hasAvx = (info[2] & (1 << 28)) != 0;
+			__cpuidex(info, 7, 0);
+			bool hasAvx2 = (info[1] & (1 << 5)) != 0;
+			if (osUsesXsave && hasAvx && hasAvx2 && (_xgetbv(0) & 6) == 6)
+			{
+				return SimdLevel::Avx2;
+			}
+		}
+#else
+		if (__builtin_cpu_supports("avx2"))
+		{
+			return SimdLevel::Avx2;
+		}
+#endif
+		// SSE2 есть на любом x64 процессоре
+		return SimdLevel::Sse2;
+#else
+		return SimdLevel::Scalar;
+#endif
+	}
+
+	// Записывает dst[i] для байтов [begin, end) строки, above и below - соседние строки,
+	// step - расстояние в байтах до соседа по горизонтали
+	static void BlurInteriorRow(SimdLevel level, const uint8_t* above, const uint8_t* row, const uint8_t* below,
+		uint8_t* dst, int begin, int end, int step = 3)
+	{
+#ifdef SIMD_BLUR_X64
+		if (level == SimdLevel::Avx2)
+		{
+			begin = BlurInteriorRowAvx2(above, row, below, dst, begin, end, step);
+		}
+		else if (level == SimdLevel::Sse2)
+		{
+			begin = BlurInteriorRowSse2(above, row, below, dst, begin, end, step);
+		}
+#endif
+		BlurInteriorRowScalar(above, row, below, dst, begin, end, step);
+	}
+
+private:
+	// x / 9 == (x * 7282) >> 16 для всех x <= 9 * 255, поэтому деление заменяется умножением
+	static constexpr uint32_t RECIPROCAL_9 = 7282;
+
+	static void BlurInteriorRowScalar(const uint8_t* above, const uint8_t* row, const uint8_t* below,
+		uint8_t* dst, int begin, int end, int step)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			uint32_t sum = above[i - step] + above[i] + above[i + step]
+				+ row[i - step] + row[i] + row[i + step]
+				+ below[i - step] + below[i] + below[i + step];
+			dst[i] = static_cast<uint8_t>((sum * RECIPROCAL_9) >> 16);
+		}
+	}
+
+#ifdef SIMD_BLUR_X64
+	static int BlurInteriorRowSse2(const uint8_t* above, const uint8_t* row, const uint8_t* below,
+		uint8_t* dst, int begin, int end, int step)
+	{
+		const uint8_t* rows[3] = { above, row, below };
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i reciprocal = _mm_set1_epi16(static_cast<short>(RECIPROCAL_9));
+
+		int i = begin;
+		for (; i + 16 <= end; i += 16)
+		{
+			__m128i lo = zero;
+			__m128i hi = zero;
+			for (const uint8_t* r : rows)
+			{
+				for (int offset : { -step, 0, step })
+				{
+					__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + i + offset));
+					lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+					hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+				}
+			}
+			lo = _mm_mulhi_epu16(lo, reciprocal);
+			hi = _mm_mulhi_epu16(hi, reciprocal);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+		}
+		return i;
+	}
+
+	SIMD_TARGET_AVX2 static int BlurInteriorRowAvx2(const uint8_t* above, const uint8_t* row, const uint8_t* below,
+		uint8_t* dst, int begin, int end, int step)
+	{
+		const uint8_t* rows[3] = { above, row, below };
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i reciprocal = _mm256_set1_epi16(static_cast<short>(RECIPROCAL_9));
+
+		// unpack и packus работают внутри 128-битных половин, поэтому порядок байтов сохраняется
+		int i = begin;
+		for (; i + 32 <= end; i += 32)
+		{
+			__m256i lo = zero;
+			__m256i hi = zero;
+			for (const uint8_t* r : rows)
+			{
+				for (int offset : { -step, 0, step })
+				{
+					__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r + i + offset));
+					lo = _mm256_add_epi16(lo, _mm256_unpacklo_epi8(v, zero));
+					hi = _mm256_add_epi16(hi, _mm256_unpackhi_epi8(v, zero));
+				}
+			}
+			lo = _mm256_mulhi_epu16(lo, reciprocal);
+			hi = _mm256_mulhi_epu16(hi, reciprocal);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packus_epi16(lo, hi));
+		}
+		return BlurInteriorRowSse2(above, row, below, dst, i, end, step);
+	}
+#endif
+};
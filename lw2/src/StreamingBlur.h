@@ -0,0 +1,195 @@
+#pragma once
+#include "BmpProcessor.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct StreamingStats
+{
+	int bands;
+	int bandRows;
+	size_t bufferBytes;
+	double readWaitMs;
+	double computeMs;
+	double writeMs;
+};
+
+// Blur изображений, которые не помещаются в память. Файл обрабатывается горизонтальными
+// полосами с ореолом в ITERATIONS строк сверху и снизу: после каждой итерации верная часть
+// полосы сужается на строку, и после всех итераций совпадает с результатом обычного BlurImage.
+// Следующая полоса читается отдельным потоком, пока считается и записывается текущая
+class StreamingBlur
+{
+public:
+	// Четыре буфера по (полоса + 2 ореола) строк: две входные полосы и два буфера итераций
+	static constexpr int BUFFERS = 4;
+
+	static StreamingStats BlurFile(const std::string& inputFile, const std::string& outputFile, int numThreads,
+		size_t memoryBudget, SimdLevel simdLevel = SimdBlur::DetectLevel(), PinPolicy pinPolicy = PinPolicy::None)
+	{
+		StreamingInput input;
+		input.stream.open(inputFile, std::ios::binary | std::ios::ate);
+		if (!input.stream)
+		{
+			throw std::runtime_error("Cannot open file");
+		}
+		auto fileSize = static_cast<uint64_t>(input.stream.tellg());
+		if (fileSize < sizeof(FileHeader) + sizeof(BitmapHeader))
+		{
+			throw std::runtime_error("File is too small for BMP headers");
+		}
+
+		FileHeader header;
+		BitmapHeader bitmapHeader;
+		input.stream.seekg(0);
+		input.stream.read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+		input.stream.read(reinterpret_cast<char*>(&bitmapHeader), sizeof(BitmapHeader));
+
+		input.rowStride = BmpProcessor::ValidateHeaders(header, bitmapHeader, fileSize);
+		input.offset = header.offset_data;
+		int width = bitmapHeader.width;
+		int height = std::abs(bitmapHeader.height);
+
+		constexpr int halo = BmpProcessor::ITERATIONS;
+		int bandRows = static_cast<int>(std::min<size_t>(memoryBudget / (BUFFERS * static_cast<size_t>(input.rowStride)), INT32_MAX)) - 2 * halo;
+		if (bandRows < 1)
+		{
+			throw std::runtime_error("Memory budget is too small for a single band");
+		}
+		bandRows = std::min(bandRows, height);
+
+		StreamingStats stats{};
+		stats.bandRows = bandRows;
+		stats.bands = (height + bandRows - 1) / bandRows;
+
+		size_t bufferSize = static_cast<size_t>(bandRows + 2 * halo) * input.rowStride;
+		std::vector<uint8_t> inputBands[2] = { std::vector<uint8_t>(bufferSize), std::vector<uint8_t>(bufferSize) };
+		std::vector<uint8_t> work[2] = { std::vector<uint8_t>(bufferSize), std::vector<uint8_t>(bufferSize) };
+		stats.bufferBytes = BUFFERS * bufferSize;
+
+		std::ofstream out(outputFile, std::ios::binary);
+		if (!out)
+		{
+			throw std::runtime_error("Cannot create file");
+		}
+		WriteHeaders(out, bitmapHeader, static_cast<size_t>(input.rowStride) * height);
+
+		WorkerPool pool(numThreads, pinPolicy);
+
+		input.buffer = &inputBands[0];
+		input.firstRow = 0;
+		input.rows = std::min(height, bandRows + halo);
+		ReadFunction(&input);
+
+		for (int band = 0; band < stats.bands; ++band)
+		{
+			int bandStart = band * bandRows;
+			int bandEnd = std::min(height, bandStart + bandRows);
+			int regionStart = std::max(0, bandStart - halo);
+			int regionRows = std::min(height, bandEnd + halo) - regionStart;
+			std::vector<uint8_t>& current = inputBands[band % 2];
+
+			// Следующая полоса читается в другой входной буфер, пока считается текущая
+			std::thread reader;
+			if (band + 1 < stats.bands)
+			{
+				input.buffer = &inputBands[(band + 1) % 2];
+				input.firstRow = std::max(0, bandEnd - halo);
+				input.rows = std::min(height, bandEnd + bandRows + halo) - input.firstRow;
+				reader = std::thread(ReadFunction, &input);
+			}
+
+			auto computeStart = std::chrono::steady_clock::now();
+			const uint8_t* result = BlurBand(pool, current.data(), work[0].data(), work[1].data(), width, regionRows,
+				input.rowStride, bandStart - regionStart, bandEnd - regionStart, simdLevel);
+			auto writeStart = std::chrono::steady_clock::now();
+			stats.computeMs += std::chrono::duration<double, std::milli>(writeStart - computeStart).count();
+
+			out.write(reinterpret_cast<const char*>(result + static_cast<size_t>(bandStart - regionStart) * input.rowStride),
+				static_cast<std::streamsize>(bandEnd - bandStart) * input.rowStride);
+			auto waitStart = std::chrono::steady_clock::now();
+			stats.writeMs += std::chrono::duration<double, std::milli>(waitStart - writeStart).count();
+
+			if (reader.joinable())
+			{
+				reader.join();
+				stats.readWaitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+			}
+		}
+
+		if (!out)
+		{
+			throw std::runtime_error("Cannot write file");
+		}
+		return stats;
+	}
+
+private:
+	struct StreamingInput
+	{
+		std::ifstream stream;
+		uint32_t offset;
+		uint32_t rowStride;
+		std::vector<uint8_t>* buffer;
+		int firstRow;
+		int rows;
+	};
+
+	// Пока идёт чтение, основной поток к StreamingInput не обращается
+	static void ReadFunction(StreamingInput* input)
+	{
+		input->stream.seekg(input->offset + static_cast<std::streamoff>(input->firstRow) * input->rowStride);
+		input->stream.read(reinterpret_cast<char*>(input->buffer->data()),
+			static_cast<std::streamsize>(input->rows) * input->rowStride);
+	}
+
+	static void WriteHeaders(std::ofstream& out, BitmapHeader bitmapHeader, size_t pixelsSize)
+	{
+		FileHeader header;
+		header.offset_data = sizeof(FileHeader) + sizeof(BitmapHeader);
+		header.file_size = static_cast<uint32_t>(header.offset_data + pixelsSize);
+		bitmapHeader.size = sizeof(BitmapHeader);
+		bitmapHeader.size_image = static_cast<uint32_t>(pixelsSize);
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+		out.write(reinterpret_cast<const char*>(&bitmapHeader), sizeof(BitmapHeader));
+	}
+
+	// Все итерации над полосой из regionRows строк, верными в итоге должны быть строки [bandStart, bandEnd).
+	// Координаты строк локальные: край полосы, совпадающий с краем изображения, обрабатывается
+	// как край изображения, а до внутреннего края вычисляемая область никогда не доходит
+	static const uint8_t* BlurBand(WorkerPool& pool, const uint8_t* input, uint8_t* first, uint8_t* second,
+		int width, int regionRows, uint32_t rowStride, int bandStart, int bandEnd, SimdLevel simdLevel)
+	{
+		constexpr int halo = BmpProcessor::ITERATIONS;
+		int numThreads = pool.Size();
+
+		pool.Run([&](int index) {
+			const uint8_t* src = input;
+			uint8_t* dst = first;
+
+			for (int iter = 1; iter <= BmpProcessor::ITERATIONS; ++iter)
+			{
+				int computeStart = std::max(0, bandStart - (halo - iter));
+				int computeEnd = std::min(regionRows, bandEnd + (halo - iter));
+				int rows = computeEnd - computeStart;
+
+				Square slice{ 0, computeStart + rows * index / numThreads, width, computeStart + rows * (index + 1) / numThreads };
+				BmpProcessor::ApplySimdBoxBlurToSquare(src, dst, slice, width, regionRows, rowStride, simdLevel);
+
+				src = dst;
+				dst = dst == first ? second : first;
+				pool.Barrier();
+			}
+		});
+
+		return BmpProcessor::ITERATIONS % 2 == 1 ? first : second;
+	}
+};
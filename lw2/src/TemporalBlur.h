@@ -0,0 +1,159 @@
+#pragma once
+#include "BmpProcessor.h"
+#include "SimdBlur.h"
+#include "TileScheduler.h"
+#include "WorkerPool.h"
+
+#include <cstring>
+#include <vector>
+
+// Временная блокировка: плитка вместе с ореолом в depth пикселей копируется в локальный буфер,
+// и к ней подряд применяются depth итераций, пока она в кэше. После каждой итерации
+// верная область сужается на пиксель с каждой стороны, кроме краёв изображения,
+// так что после depth итераций сама плитка совпадает с результатом обычного цикла
+class TemporalBlur
+{
+public:
+	static void BlurImage(FileData& fileData, int numThreads, const BlurOptions& options = {})
+	{
+		int width = static_cast<int>(fileData.GetWidth());
+		int height = static_cast<int>(fileData.GetHeight());
+		int depth = std::max(1, std::min(options.temporalDepth, BmpProcessor::ITERATIONS));
+
+		auto tiles = BmpProcessor::DivideIntoTiles(width, height, options.tileSize);
+		WorkStealingScheduler scheduler(numThreads);
+		std::vector<uint8_t> temp = fileData.pixels;
+		size_t localSize = static_cast<size_t>(options.tileSize + 2 * depth) * (options.tileSize + 2 * depth) * 3;
+
+		WorkerPool pool(numThreads, options.pinPolicy);
+		pool.Run([&](int index) {
+			std::vector<uint8_t> local[2] = { std::vector<uint8_t>(localSize), std::vector<uint8_t>(localSize) };
+			const std::vector<uint8_t>* src = &fileData.pixels;
+			std::vector<uint8_t>* dst = &temp;
+
+			for (int done = 0; done < BmpProcessor::ITERATIONS; done += depth)
+			{
+				int steps = std::min(depth, BmpProcessor::ITERATIONS - done);
+
+				if (options.scheduler == SchedulerType::WorkStealing)
+				{
+					scheduler.Fill(index, tiles);
+					pool.Barrier();
+
+					Square tile{};
+					while (scheduler.Next(index, tile))
+					{
+						BlurTile(*src, *dst, local, tile, steps, width, height, fileData.GetRowStride(), options.simdLevel);
+					}
+				}
+				else
+				{
+					for (size_t i = index; i < tiles.size(); i += numThreads)
+					{
+						BlurTile(*src, *dst, local, tiles[i], steps, width, height, fileData.GetRowStride(), options.simdLevel);
+					}
+				}
+
+				src = dst;
+				dst = dst == &temp ? &fileData.pixels : &temp;
+				pool.Barrier();
+			}
+		});
+
+		// Число проходов по изображению нечётное - результат во втором буфере
+		int passes = (BmpProcessor::ITERATIONS + depth - 1) / depth;
+		if (passes % 2 == 1)
+		{
+			fileData.pixels.swap(temp);
+		}
+	}
+
+private:
+	static Square Expand(const Square& tile, int by, int width, int height)
+	{
+		return { std::max(0, tile.startX - by), std::max(0, tile.startY - by),
+			std::min(width, tile.endX + by), std::min(height, tile.endY + by) };
+	}
+
+	static void BlurTile(const std::vector<uint8_t>& src, std::vector<uint8_t>& dst, std::vector<uint8_t> (&local)[2],
+		const Square& tile, int steps, int width, int height, uint32_t rowStride, SimdLevel simdLevel)
+	{
+		Square region = Expand(tile, steps, width, height);
+		int localStride = (region.endX - region.startX) * 3;
+
+		for (int y = region.startY; y < region.endY; ++y)
+		{
+			std::memcpy(local[0].data() + (y - region.startY) * localStride,
+				src.data() + y * rowStride + region.startX * 3, localStride);
+		}
+
+		int current = 0;
+		for (int step = 1; step <= steps; ++step)
+		{
+			Square compute = Expand(tile, steps - step, width, height);
+			BlurRegion(local[current].data(), local[1 - current].data(), localStride, region, compute,
+				width, height, simdLevel);
+			current = 1 - current;
+		}
+
+		int tileBytes = (tile.endX - tile.startX) * 3;
+		for (int y = tile.startY; y < tile.endY; ++y)
+		{
+			std::memcpy(dst.data() + y * rowStride + tile.startX * 3,
+				local[current].data() + (y - region.startY) * localStride + (tile.startX - region.startX) * 3, tileBytes);
+		}
+	}
+
+	// Один проход 3x3 над областью compute локального буфера, который покрывает region.
+	// Координаты глобальные, деление на число соседей как в ApplyBoxBlurToSquare
+	static void BlurRegion(const uint8_t* src, uint8_t* dst, int localStride, const Square& region,
+		const Square& compute, int width, int height, SimdLevel simdLevel)
+	{
+		auto offset = [&](int x, int y) { return (y - region.startY) * localStride + (x - region.startX) * 3; };
+
+		Square inner{ std::max(compute.startX, 1), std::max(compute.startY, 1),
+			std::min(compute.endX, width - 1), std::min(compute.endY, height - 1) };
+		if (inner.startX >= inner.endX || inner.startY >= inner.endY)
+		{
+			inner = { compute.startX, compute.startY, compute.startX, compute.startY };
+		}
+
+		for (int y = compute.startY; y < compute.endY; ++y)
+		{
+			bool innerRow = y >= inner.startY && y < inner.endY;
+			for (int x = compute.startX; x < compute.endX; ++x)
+			{
+				if (innerRow && x == inner.startX)
+				{
+					x = inner.endX - 1;
+					continue;
+				}
+
+				int r = 0, g = 0, b = 0, count = 0;
+				for (int ny = std::max(0, y - 1); ny <= std::min(height - 1, y + 1); ++ny)
+				{
+					for (int nx = std::max(0, x - 1); nx <= std::min(width - 1, x + 1); ++nx)
+					{
+						const uint8_t* pixel = src + offset(nx, ny);
+						b += pixel[0];
+						g += pixel[1];
+						r += pixel[2];
+						++count;
+					}
+				}
+
+				uint8_t* pixel = dst + offset(x, y);
+				pixel[0] = static_cast<uint8_t>(b / count);
+				pixel[1] = static_cast<uint8_t>(g / count);
+				pixel[2] = static_cast<uint8_t>(r / count);
+			}
+
+			if (innerRow)
+			{
+				const uint8_t* row = src + offset(region.startX, y);
+				SimdBlur::BlurInteriorRow(simdLevel, row - localStride, row, row + localStride, dst + offset(region.startX, y),
+					(inner.startX - region.startX) * 3, (inner.endX - region.startX) * 3);
+			}
+		}
+	}
+};
@@ -0,0 +1,166 @@
+#pragma once
+#include "BmpProcessor.h"
+#include "Platform.h"
+#include "WorkerPool.h"
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct TileChoice
+{
+	TileShape shape;
+	int tileSize;
+	bool cached;
+};
+
+// Подбирает разбиение для статического планировщика: каждая форма плиток прогоняется
+// несколько итераций на шумовом изображении того же размера, и побеждает самая быстрая.
+// Выбор сохраняется в файл кэша с ключом из машины, числа потоков и класса размера изображения
+class TileAutotuner
+{
+public:
+	static TileChoice Choose(uint32_t width, uint32_t height, WorkerPool& pool, const BlurOptions& options,
+		const std::string& cacheFile)
+	{
+		std::string key = MakeKey(width, height, pool.Size(), options);
+		std::map<std::string, TileChoice> cache = Load(cacheFile);
+		auto found = cache.find(key);
+		if (found != cache.end())
+		{
+			return { found->second.shape, found->second.tileSize, true };
+		}
+
+		TileChoice choice = Calibrate(width, height, pool, options);
+		cache[key] = choice;
+		Save(cacheFile, cache);
+		return choice;
+	}
+
+	static const char* ShapeName(TileShape shape)
+	{
+		switch (shape)
+		{
+		case TileShape::Strips:
+			return "strips";
+		case TileShape::Morton:
+			return "morton";
+		default:
+			return "squares";
+		}
+	}
+
+private:
+	static constexpr int CALIBRATION_ITERATIONS = 3;
+	static constexpr int CALIBRATION_RUNS = 3;
+	static constexpr int MORTON_TILE_SIZES[] = { 16, 32, 64, 128 };
+
+	// Изображения одного порядка числа пикселей и одной ориентации ведут себя одинаково
+	static std::string MakeKey(uint32_t width, uint32_t height, int numThreads, const BlurOptions& options)
+	{
+		const char* simd = options.simdLevel == SimdLevel::Avx2 ? "avx2" : options.simdLevel == SimdLevel::Sse2 ? "sse2" : "scalar";
+		int sizeClass = static_cast<int>(std::lround(std::log2(static_cast<double>(width) * height)));
+		const char* aspect = width >= 2 * height ? "wide" : height >= 2 * width ? "tall" : "square";
+
+		std::ostringstream key;
+		key << "cpus" << CpuTopology::Get().GetCpus().size() << "-" << simd << "-threads" << numThreads
+			<< "-radius" << options.radius << "-px" << sizeClass << "-" << aspect;
+		return key.str();
+	}
+
+	static TileChoice Calibrate(uint32_t width, uint32_t height, WorkerPool& pool, const BlurOptions& options)
+	{
+		uint32_t rowStride = (width * 3 + 3) & ~3u;
+		std::vector<uint8_t> input(static_cast<size_t>(rowStride) * height);
+		std::mt19937 random(12345);
+		for (uint8_t& byte : input)
+		{
+			byte = static_cast<uint8_t>(random());
+		}
+		std::vector<uint8_t> first = input;
+		std::vector<uint8_t> second = input;
+
+		std::vector<TileChoice> candidates{ { TileShape::Squares, options.tileSize, false }, { TileShape::Strips, options.tileSize, false } };
+		for (int tileSize : MORTON_TILE_SIZES)
+		{
+			if (tileSize < static_cast<int>(std::max(width, height)))
+			{
+				candidates.push_back({ TileShape::Morton, tileSize, false });
+			}
+		}
+
+		TileChoice best = candidates.front();
+		double bestMs = std::numeric_limits<double>::max();
+		for (const TileChoice& candidate : candidates)
+		{
+			BlurOptions trial = options;
+			trial.scheduler = SchedulerType::Static;
+			trial.tileShape = candidate.shape;
+			trial.tileSize = candidate.tileSize;
+
+			// Первый прогон прогревает кэши и не учитывается
+			double candidateMs = std::numeric_limits<double>::max();
+			for (int run = 0; run <= CALIBRATION_RUNS; ++run)
+			{
+				auto start = std::chrono::steady_clock::now();
+				BmpProcessor::BlurPixels(input.data(), first.data(), second.data(), width, height, rowStride, pool, trial,
+					CALIBRATION_ITERATIONS);
+				double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				if (run > 0)
+				{
+					candidateMs = std::min(candidateMs, ms);
+				}
+			}
+
+			if (candidateMs < bestMs)
+			{
+				bestMs = candidateMs;
+				best = candidate;
+			}
+		}
+		return best;
+	}
+
+	// Формат строки кэша: "<ключ> <форма> <размер плитки>"
+	static std::map<std::string, TileChoice> Load(const std::string& cacheFile)
+	{
+		std::map<std::string, TileChoice> cache;
+		std::ifstream in(cacheFile);
+		std::string key;
+		std::string shape;
+		int tileSize = 0;
+		while (in >> key >> shape >> tileSize)
+		{
+			for (TileShape candidate : { TileShape::Squares, TileShape::Strips, TileShape::Morton })
+			{
+				if (shape == ShapeName(candidate) && tileSize > 0)
+				{
+					cache[key] = { candidate, tileSize, true };
+				}
+			}
+		}
+		return cache;
+	}
+
+	// Кэш только ускоряет следующие запуски, поэтому ошибка записи не прерывает текущий
+	static void Save(const std::string& cacheFile, const std::map<std::string, TileChoice>& cache)
+	{
+		std::ofstream out(cacheFile);
+		for (const auto& [key, choice] : cache)
+		{
+			out << key << " " << ShapeName(choice.shape) << " " << choice.tileSize << "\n";
+		}
+		out.flush();
+		if (!out)
+		{
+			std::cerr << cacheFile << ": Cannot write tiling cache, the choice is used only in this run\n";
+		}
+	}
+};
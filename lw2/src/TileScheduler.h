@@ -0,0 +1,185 @@
+#pragma once
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct Square
+{
+	int startX, startY;
+	int endX, endY;
+};
+
+// Область интереса в координатах изображения сверху вниз, как его видит пользователь.
+// Пересекающиеся с ней плитки обрабатываются в каждой итерации раньше остальных
+struct RegionOfInterest
+{
+	Square rect;
+	int priority = 1;
+};
+
+// Приоритет плитки - наибольший среди пересекающихся с ней областей, 0 - вне областей.
+// Строки BMP хранятся снизу вверх, поэтому области переворачиваются по высоте
+class TilePriorities
+{
+public:
+	TilePriorities(const std::vector<RegionOfInterest>& regions, int height)
+	{
+		for (const RegionOfInterest& region : regions)
+		{
+			if (region.priority > 0)
+			{
+				m_regions.push_back({ { region.rect.startX, height - region.rect.endY, region.rect.endX, height - region.rect.startY },
+					region.priority });
+			}
+		}
+	}
+
+	bool IsEmpty() const { return m_regions.empty(); }
+
+	int Get(const Square& tile) const
+	{
+		int priority = 0;
+		for (const RegionOfInterest& region : m_regions)
+		{
+			const Square& rect = region.rect;
+			if (tile.startX < rect.endX && rect.startX < tile.endX && tile.startY < rect.endY && rect.startY < tile.endY)
+			{
+				priority = std::max(priority, region.priority);
+			}
+		}
+		return priority;
+	}
+
+	// По убыванию приоритета, внутри приоритета порядок сохраняется
+	void Sort(std::vector<Square>& tiles) const
+	{
+		std::ranges::stable_sort(tiles, std::greater{}, [this](const Square& tile) { return Get(tile); });
+	}
+
+private:
+	std::vector<RegionOfInterest> m_regions;
+};
+
+struct WorkerStats
+{
+	int executed = 0;
+	int stolen = 0;
+};
+
+// Динамическое распределение плиток: у каждого потока своя очередь, из которой он
+// берёт плитки с конца, а освободившийся поток забирает плитки с начала чужих очередей.
+// Так медленный или вытесненный поток не задерживает всю итерацию
+class WorkStealingScheduler
+{
+public:
+	explicit WorkStealingScheduler(int numWorkers)
+	{
+		for (int i = 0; i < numWorkers; ++i)
+		{
+			m_queues.push_back(std::make_unique<WorkerQueue>());
+		}
+	}
+
+	// Кладёт в очередь потока его непрерывный кусок плиток, вызывается самим потоком
+	void Fill(int worker, const std::vector<Square>& tiles)
+	{
+		FillRange(worker, tiles.begin(), tiles.end());
+	}
+
+	// Для плиток, упорядоченных по убыванию приоритета, из которых первые priorityCount
+	// пересекают области интереса. Эти плитки лежат в общей очереди, и любой поток берёт
+	// их раньше своих, поэтому они не ждут в очереди вытесненного потока, пока остальные
+	// потоки считают и воруют обычные плитки. Остальные плитки распределяются как в Fill
+	void FillByPriority(int worker, const std::vector<Square>& tiles, size_t priorityCount)
+	{
+		if (worker == 0)
+		{
+			std::lock_guard lock(m_priority.mutex);
+			m_priority.tiles.assign(tiles.begin(), tiles.begin() + priorityCount);
+		}
+		FillRange(worker, tiles.begin() + priorityCount, tiles.end());
+	}
+
+	bool Next(int worker, Square& tile)
+	{
+		WorkerQueue& own = *m_queues[worker];
+		if (PopFront(m_priority, tile) || PopBack(own, tile))
+		{
+			++own.stats.executed;
+			return true;
+		}
+
+		int numWorkers = static_cast<int>(m_queues.size());
+		for (int i = 1; i < numWorkers; ++i)
+		{
+			if (PopFront(*m_queues[(worker + i) % numWorkers], tile))
+			{
+				++own.stats.executed;
+				++own.stats.stolen;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::vector<WorkerStats> GetStats() const
+	{
+		std::vector<WorkerStats> stats;
+		for (const auto& queue : m_queues)
+		{
+			stats.push_back(queue->stats);
+		}
+		return stats;
+	}
+
+private:
+	// Выравнивание по кэш-линии, чтобы счётчики соседних потоков не делили одну линию
+	struct alignas(64) WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<Square> tiles;
+		WorkerStats stats;
+	};
+
+	void FillRange(int worker, std::vector<Square>::const_iterator first, std::vector<Square>::const_iterator last)
+	{
+		int numWorkers = static_cast<int>(m_queues.size());
+		size_t count = last - first;
+		size_t begin = count * worker / numWorkers;
+		size_t end = count * (worker + 1) / numWorkers;
+
+		WorkerQueue& queue = *m_queues[worker];
+		std::lock_guard lock(queue.mutex);
+		queue.tiles.assign(first + begin, first + end);
+	}
+
+	static bool PopBack(WorkerQueue& queue, Square& tile)
+	{
+		std::lock_guard lock(queue.mutex);
+		if (queue.tiles.empty())
+		{
+			return false;
+		}
+		tile = queue.tiles.back();
+		queue.tiles.pop_back();
+		return true;
+	}
+
+	static bool PopFront(WorkerQueue& queue, Square& tile)
+	{
+		std::lock_guard lock(queue.mutex);
+		if (queue.tiles.empty())
+		{
+			return false;
+		}
+		tile = queue.tiles.front();
+		queue.tiles.pop_front();
+		return true;
+	}
+
+	std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+	WorkerQueue m_priority;
+};
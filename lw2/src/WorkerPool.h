@@ -0,0 +1,121 @@
+#pragma once
+#include "Platform.h"
+
+#include <barrier>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Потоки создаются один раз в конструкторе и ждут задач, поэтому повторные запуски
+// и итерации внутри задачи обходятся без создания потоков.
+// При политике привязки поток i закрепляется за (firstCpu + i)-м CPU из Platform::PlanThreadCpus,
+// так что несколько пулов могут занять разные CPU
+class WorkerPool
+{
+public:
+	explicit WorkerPool(int numThreads, PinPolicy pinPolicy = PinPolicy::None, int firstCpu = 0)
+		: m_barrier(numThreads)
+		, m_cpus(Platform::PlanThreadCpus(pinPolicy))
+		, m_firstCpu(firstCpu)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < numThreads; ++i)
+		{
+			m_threads.emplace_back(&WorkerPool::WorkerFunction, this, i);
+		}
+
+		m_startupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	~WorkerPool()
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_stopping = true;
+		}
+		m_startCondition.notify_all();
+
+		for (std::thread& thread : m_threads)
+		{
+			thread.join();
+		}
+	}
+
+	int Size() const { return static_cast<int>(m_threads.size()); }
+	double GetStartupMs() const { return m_startupMs; }
+
+	// CPU потока index или -1, если потоки не привязаны
+	int GetCpu(int index) const { return m_cpus.empty() ? -1 : m_cpus[(m_firstCpu + index) % m_cpus.size()]; }
+
+	// Выполняет task(workerIndex) на каждом потоке и ждёт, пока все закончат
+	void Run(const std::function<void(int)>& task)
+	{
+		std::unique_lock lock(m_mutex);
+		m_task = &task;
+		m_remaining = Size();
+		++m_generation;
+		m_startCondition.notify_all();
+
+		m_doneCondition.wait(lock, [this] { return m_remaining == 0; });
+		m_task = nullptr;
+	}
+
+	// Должен вызываться всеми потоками пула внутри Run
+	void Barrier()
+	{
+		m_barrier.arrive_and_wait();
+	}
+
+private:
+	void WorkerFunction(int index)
+	{
+		if (!m_cpus.empty())
+		{
+			Platform::PinCurrentThread(GetCpu(index));
+		}
+
+		uint64_t seenGeneration = 0;
+		while (true)
+		{
+			const std::function<void(int)>* task;
+			{
+				std::unique_lock lock(m_mutex);
+				m_startCondition.wait(lock, [&] { return m_stopping || m_generation != seenGeneration; });
+				if (m_stopping)
+				{
+					return;
+				}
+				seenGeneration = m_generation;
+				task = m_task;
+			}
+
+			(*task)(index);
+
+			std::lock_guard lock(m_mutex);
+			if (--m_remaining == 0)
+			{
+				m_doneCondition.notify_one();
+			}
+		}
+	}
+
+	std::vector<std::thread> m_threads;
+	std::barrier<> m_barrier;
+	std::vector<int> m_cpus;
+	int m_firstCpu;
+	std::mutex m_mutex;
+	std::condition_variable m_startCondition;
+	std::condition_variable m_doneCondition;
+	const std::function<void(int)>* m_task = nullptr;
+	uint64_t m_generation = 0;
+	int m_remaining = 0;
+	bool m_stopping = false;
+	double m_startupMs = 0;
+};
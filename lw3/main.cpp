@@ -1,33 +1,51 @@
+#include "src/AsyncLogger.h"
+#include "src/EventLog.h"
+#include "src/LatencyHistogram.h"
+
+#include <algorithm>
 #include <cmath>
 #include <format>
 #include <fstream>
 #include <iostream>
-#include <mutex>
+#include <string>
+#include <vector>
 #include <windows.h>
 
 constexpr int OPERATIONS_COUNT = 20;
 constexpr int THREADS_COUNT = 2;
 constexpr DWORD SLEEP_TIME = 10;
-constexpr std::string OUTPUT_FILE = "thread_log.txt";
+constexpr const char* OUTPUT_FILE = "thread_log.txt";
+// С --binary отметки пишутся в двоичный журнал, текст из него делает lw4_event_decoder
+constexpr const char* BINARY_OUTPUT_FILE = "thread_log.bin";
+// Гистограмма времени записи в лог, строки Serialize можно сливать между запусками
+constexpr const char* HISTOGRAM_FILE = "thread_log.hdr";
 
 struct ThreadData
 {
 	int threadNumber;
 	DWORD startTime;
-	HANDLE hFile, mutex;
+	AsyncLogger* logger;
+	EventStream* events;
+	LatencyHistogram logTimes;
 };
 DWORD WINAPI ThreadFunction(LPVOID lpParam)
 {
-	const auto* data = static_cast<ThreadData*>(lpParam);
+	auto* data = static_cast<ThreadData*>(lpParam);
+	const EventClock& clock = EventClock::Get();
 
 	for (int i = 0; i < OPERATIONS_COUNT; ++i)
 	{
-		DWORD currentTime = timeGetTime() - data->startTime;
-		std::string buffer = std::to_string(data->threadNumber) + '|' + std::to_string(currentTime) + '\n';
-
-		WaitForSingleObject(data->mutex, INFINITE);
-		WriteFile(data->hFile, buffer.c_str(), buffer.size(), nullptr, nullptr);
-		ReleaseMutex(data->mutex);
+		uint64_t logStart = clock.Now();
+		if (data->events != nullptr)
+		{
+			data->events->Record(EVENT_SAMPLE);
+		}
+		else
+		{
+			DWORD currentTime = timeGetTime() - data->startTime;
+			data->logger->Log(data->threadNumber - 1, { data->threadNumber, currentTime });
+		}
+		data->logTimes.Record(clock.ToNs(clock.Now() - logStart));
 
 		volatile double x = 0.0;
 		for (int j = 0; j < 100000; j++)
@@ -48,26 +66,160 @@ void ClearFile(const std::string& fileName)
 	}
 }
 
-int main()
+// Замер стоимости записи в лог без вычислительной нагрузки: прежний вариант с мьютексом
+// и WriteFile на каждую строку, AsyncLogger и двоичный EventLog
+constexpr int BENCH_LINES_PER_THREAD = 20000;
+constexpr int BENCH_THREADS[] = { 2, 8, 64 };
+constexpr const char* BENCH_FILE = "logger_bench.txt";
+constexpr const char* BENCH_BINARY_FILE = "logger_bench.bin";
+
+enum class BenchMode
+{
+	Mutex,
+	Async,
+	Binary,
+};
+
+struct BenchThreadData
+{
+	int threadNumber;
+	HANDLE hFile, mutex;
+	AsyncLogger* logger;
+	EventStream* events;
+	LARGE_INTEGER frequency;
+	LatencyHistogram latencies;
+};
+
+DWORD WINAPI BenchThreadFunction(LPVOID lpParam)
+{
+	auto* data = static_cast<BenchThreadData*>(lpParam);
+	for (int i = 0; i < BENCH_LINES_PER_THREAD; ++i)
+	{
+		LARGE_INTEGER before, after;
+		QueryPerformanceCounter(&before);
+		if (data->events != nullptr)
+		{
+			data->events->Record(EVENT_SAMPLE);
+		}
+		else if (data->logger != nullptr)
+		{
+			data->logger->Log(data->threadNumber - 1, { data->threadNumber, static_cast<DWORD>(i) });
+		}
+		else
+		{
+			std::string buffer = std::to_string(data->threadNumber) + '|' + std::to_string(i) + '\n';
+			WaitForSingleObject(data->mutex, INFINITE);
+			WriteFile(data->hFile, buffer.c_str(), buffer.size(), nullptr, nullptr);
+			ReleaseMutex(data->mutex);
+		}
+		QueryPerformanceCounter(&after);
+		data->latencies.Record((after.QuadPart - before.QuadPart) * 1000000000 / data->frequency.QuadPart);
+	}
+	return 0;
+}
+
+void RunBenchmark(int threadsCount, BenchMode mode)
+{
+	HANDLE mutex = CreateMutex(nullptr, false, nullptr);
+	HANDLE file = CreateFile(BENCH_FILE, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		throw std::invalid_argument("Ошибка: не удалось создать файл для записи!");
+	}
+
+	LARGE_INTEGER frequency, start, end;
+	QueryPerformanceFrequency(&frequency);
+	auto logger = mode == BenchMode::Async ? std::make_unique<AsyncLogger>(file, threadsCount) : nullptr;
+	auto events = mode == BenchMode::Binary ? std::make_unique<EventLog>(BENCH_BINARY_FILE, threadsCount) : nullptr;
+	std::vector<BenchThreadData> threadData(threadsCount);
+	std::vector<HANDLE> handles(threadsCount);
+
+	QueryPerformanceCounter(&start);
+	for (int i = 0; i < threadsCount; ++i)
+	{
+		threadData[i].threadNumber = i + 1;
+		threadData[i].hFile = file;
+		threadData[i].mutex = mutex;
+		threadData[i].logger = logger.get();
+		threadData[i].events = events ? &events->Stream(i + 1) : nullptr;
+		threadData[i].frequency = frequency;
+		handles[i] = CreateThread(nullptr, 0, BenchThreadFunction, &threadData[i], 0, nullptr);
+	}
+	WaitForMultipleObjects(threadsCount, handles.data(), TRUE, INFINITE);
+	// Время до сброса последней строки в файл, а не только до возврата из Log
+	uint64_t dropped = 0;
+	if (logger)
+	{
+		logger->Stop();
+		dropped = logger->GetDropped();
+	}
+	if (events)
+	{
+		events->Close();
+	}
+	QueryPerformanceCounter(&end);
+
+	LatencyHistogram latencies;
+	for (int i = 0; i < threadsCount; ++i)
+	{
+		CloseHandle(handles[i]);
+		latencies.Merge(threadData[i].latencies);
+	}
+	double seconds = static_cast<double>(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+
+	auto us = [&](double percent) { return latencies.GetPercentile(percent) / 1000.0; };
+	std::cout << std::format("{:>7} {:>6} {:>14.0f} {:>10.2f} {:>10.2f} {:>10.2f} {:>10.2f} {:>9}\n", threadsCount,
+		mode == BenchMode::Async ? "async" : mode == BenchMode::Binary ? "binary" : "mutex", latencies.GetCount() / seconds,
+		us(50), us(99), us(99.9), latencies.GetMax() / 1000.0, dropped);
+
+	CloseHandle(file);
+	CloseHandle(mutex);
+}
+
+int main(int argc, char* argv[])
 {
 	SetProcessPriorityBoost(GetCurrentProcess(), true);
 	SetConsoleOutputCP(CP_UTF8);
 	SetConsoleCP(CP_UTF8);
+
+	if (argc == 2 && std::string(argv[1]) == "--bench")
+	{
+		std::cout << "Потоки  Режим   Строк в секунду  p50, мкс   p99, мкс p99.9, мкс   max, мкс  Потеряно\n";
+		for (int threadsCount : BENCH_THREADS)
+		{
+			RunBenchmark(threadsCount, BenchMode::Mutex);
+			RunBenchmark(threadsCount, BenchMode::Async);
+			RunBenchmark(threadsCount, BenchMode::Binary);
+		}
+		return 0;
+	}
+
+	bool binary = argc == 2 && std::string(argv[1]) == "--binary";
+	if (argc > 1 && !binary)
+	{
+		std::cerr << "Использование: " << argv[0] << " [--bench | --binary]\n";
+		return 1;
+	}
+
+	// Калибровка часов журнала и замера записи в лог занимает несколько миллисекунд
+	// и проходит до старта потоков
+	EventClock::Get();
+	auto events = binary ? std::make_unique<EventLog>(BINARY_OUTPUT_FILE, THREADS_COUNT) : nullptr;
 	ClearFile(OUTPUT_FILE);
 	std::cout << "Запуск потоков..." << std::endl;
 	DWORD startTime = timeGetTime();
 
 	SetProcessAffinityMask(GetCurrentProcess(), 0b1);
 
-	HANDLE mutex = CreateMutex(nullptr, false, nullptr);
 	HANDLE file = CreateFile(
-		OUTPUT_FILE.c_str(),
+		OUTPUT_FILE,
 		GENERIC_WRITE,
 		0,
 		nullptr,
 		CREATE_ALWAYS,
 		FILE_ATTRIBUTE_NORMAL,
 		nullptr);
+	AsyncLogger logger(file, THREADS_COUNT);
 	ThreadData threadData[THREADS_COUNT];
 	HANDLE handles[THREADS_COUNT];
 
@@ -76,8 +228,9 @@ int main()
 		threadData[i] = {
 			i + 1,
 			startTime,
-			file,
-			mutex
+			&logger,
+			events ? &events->Stream(i + 1) : nullptr,
+			{}
 		};
 		handles[i] = CreateThread(
 			nullptr,
@@ -91,9 +244,26 @@ int main()
 	SetThreadPriority(handles[1], THREAD_PRIORITY_HIGHEST);
 	WaitForMultipleObjects(THREADS_COUNT, handles, TRUE, INFINITE);
 
-	for (HANDLE& handle : handles)
+	LatencyHistogram logTimes;
+	for (int i = 0; i < THREADS_COUNT; ++i)
+	{
+		CloseHandle(handles[i]);
+		logTimes.Merge(threadData[i].logTimes);
+	}
+	std::cout << "Время записи в лог: ";
+	logTimes.PrintPercentiles(std::cout);
+	std::cout << std::endl;
+	std::ofstream histogramFile(HISTOGRAM_FILE);
+	histogramFile << logTimes.Serialize() << "\n";
+
+	// Все строки потоков попадают в файл до его закрытия
+	logger.Stop();
+	CloseHandle(file);
+	if (events)
 	{
-		CloseHandle(handle);
+		events->Close();
+		std::cout << "Двоичный журнал: " << BINARY_OUTPUT_FILE << ", текст: lw4_event_decoder "
+				  << BINARY_OUTPUT_FILE << " --text=" << OUTPUT_FILE << std::endl;
 	}
 
 	return 0;
@@ -0,0 +1,189 @@
+#pragma once
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <windows.h>
+
+struct LogRecord
+{
+	int threadNumber;
+	DWORD time;
+};
+
+// Что делает поток, когда его очередь заполнена
+enum class OverflowPolicy
+{
+	// Ждёт, пока фоновый поток освободит место: ни одна строка не теряется
+	Block,
+	// Отбрасывает запись и считает потерянные строки
+	Drop,
+};
+
+// Асинхронный лог: у каждого потока своя очередь фиксированного размера (один писатель, один
+// читатель), поэтому запись не берёт блокировок и не форматирует строку. Фоновый поток забирает
+// записи из всех очередей, форматирует их в большой буфер и пишет его одним WriteFile.
+// Внутри одной пачки строки сгруппированы по потокам, порядок задают метки времени
+class AsyncLogger
+{
+public:
+	static constexpr size_t WRITE_BUFFER_SIZE = 64 * 1024;
+	static constexpr size_t DEFAULT_CAPACITY = 4096;
+
+	AsyncLogger(HANDLE file, int producers, size_t capacity = DEFAULT_CAPACITY, OverflowPolicy policy = OverflowPolicy::Block)
+		: m_file(file)
+		, m_policy(policy)
+	{
+		for (int i = 0; i < producers; ++i)
+		{
+			m_queues.push_back(std::make_unique<Queue>(std::bit_ceil(capacity)));
+		}
+		m_buffer.reserve(WRITE_BUFFER_SIZE);
+		m_writer = CreateThread(nullptr, 0, WriterFunction, this, 0, nullptr);
+	}
+
+	// Все записи, принятые до вызова, будут записаны в файл
+	~AsyncLogger()
+	{
+		Stop();
+	}
+
+	AsyncLogger(const AsyncLogger&) = delete;
+	AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+	// Вызывается только потоком producer. false - запись отброшена
+	bool Log(int producer, const LogRecord& record)
+	{
+		Queue& queue = *m_queues[producer];
+		size_t tail = queue.tail.load(std::memory_order_relaxed);
+		while (tail - queue.head.load(std::memory_order_acquire) > queue.mask)
+		{
+			if (m_policy == OverflowPolicy::Drop || m_stopping.load(std::memory_order_relaxed))
+			{
+				queue.dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			SwitchToThread();
+		}
+
+		queue.records[tail & queue.mask] = record;
+		queue.tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Дописывает всё накопленное и останавливает фоновый поток. Вызывается после завершения
+	// потоков, пишущих в лог, повторный вызов ничего не делает
+	void Stop()
+	{
+		if (m_writer == nullptr)
+		{
+			return;
+		}
+		m_stopping.store(true, std::memory_order_release);
+		WaitForSingleObject(m_writer, INFINITE);
+		CloseHandle(m_writer);
+		m_writer = nullptr;
+	}
+
+	uint64_t GetWritten() const { return m_written; }
+
+	uint64_t GetDropped() const
+	{
+		uint64_t dropped = 0;
+		for (const auto& queue : m_queues)
+		{
+			dropped += queue->dropped.load(std::memory_order_relaxed);
+		}
+		return dropped;
+	}
+
+private:
+	// head двигает фоновый поток, tail - писатель, они лежат в разных кэш-линиях
+	struct Queue
+	{
+		explicit Queue(size_t capacity)
+			: records(capacity)
+			, mask(capacity - 1)
+		{
+		}
+
+		std::vector<LogRecord> records;
+		size_t mask;
+		alignas(64) std::atomic<size_t> head{ 0 };
+		alignas(64) std::atomic<size_t> tail{ 0 };
+		std::atomic<uint64_t> dropped{ 0 };
+	};
+
+	static DWORD WINAPI WriterFunction(LPVOID lpParam)
+	{
+		auto* logger = static_cast<AsyncLogger*>(lpParam);
+		while (!logger->m_stopping.load(std::memory_order_acquire))
+		{
+			// Пока записи идут, буфер копится до WRITE_BUFFER_SIZE, в простое сбрасывается
+			if (logger->Drain() == 0)
+			{
+				logger->Flush();
+				Sleep(1);
+			}
+		}
+		while (logger->Drain() > 0)
+		{
+		}
+		logger->Flush();
+		return 0;
+	}
+
+	size_t Drain()
+	{
+		size_t drained = 0;
+		for (const auto& queue : m_queues)
+		{
+			size_t head = queue->head.load(std::memory_order_relaxed);
+			size_t tail = queue->tail.load(std::memory_order_acquire);
+			drained += tail - head;
+			for (; head != tail; ++head)
+			{
+				Format(queue->records[head & queue->mask]);
+			}
+			queue->head.store(tail, std::memory_order_release);
+		}
+		m_written += drained;
+		return drained;
+	}
+
+	// Строка "<номер потока>|<время>", как в прежнем логе
+	void Format(const LogRecord& record)
+	{
+		constexpr size_t MAX_LINE = 48;
+		if (m_buffer.size() + MAX_LINE > WRITE_BUFFER_SIZE)
+		{
+			Flush();
+		}
+		// Место под разделители оставлено заранее, поэтому to_chars не может упереться в конец
+		char line[MAX_LINE];
+		char* end = std::to_chars(line, line + MAX_LINE / 2, record.threadNumber).ptr;
+		*end++ = '|';
+		end = std::to_chars(end, line + MAX_LINE - 1, record.time).ptr;
+		*end++ = '\n';
+		m_buffer.insert(m_buffer.end(), line, end);
+	}
+
+	void Flush()
+	{
+		if (!m_buffer.empty())
+		{
+			WriteFile(m_file, m_buffer.data(), static_cast<DWORD>(m_buffer.size()), nullptr, nullptr);
+			m_buffer.clear();
+		}
+	}
+
+	HANDLE m_file;
+	OverflowPolicy m_policy;
+	std::vector<std::unique_ptr<Queue>> m_queues;
+	std::vector<char> m_buffer;
+	uint64_t m_written = 0;
+	std::atomic<bool> m_stopping{ false };
+	HANDLE m_writer = nullptr;
+};
@@ -0,0 +1,149 @@
+#include "src/EventLog.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+// Переводит двоичный журнал EventLog (lw3 --binary, lw4 --events) в текст "<поток>|<мс>"
+// из отметок EVENT_SAMPLE и печатает сводку по потокам
+
+struct ThreadSummary
+{
+	std::map<uint16_t, uint64_t> counts;
+	uint64_t firstNs = std::numeric_limits<uint64_t>::max();
+	uint64_t lastNs = 0;
+	uint64_t samples = 0;
+	uint64_t lastSampleNs = 0;
+	uint64_t minGapNs = std::numeric_limits<uint64_t>::max();
+	uint64_t maxGapNs = 0;
+	uint64_t sumGapNs = 0;
+};
+
+const char* EventName(uint16_t eventId)
+{
+	switch (eventId)
+	{
+	case EVENT_SAMPLE:
+		return "sample";
+	case EVENT_ITERATION_BEGIN:
+		return "iteration begin";
+	case EVENT_ITERATION_END:
+		return "iteration end";
+	case EVENT_TILE_BEGIN:
+		return "tile begin";
+	case EVENT_TILE_END:
+		return "tile end";
+	default:
+		return "other";
+	}
+}
+
+void WriteText(const std::string& filename, std::vector<DecodedEvent> events)
+{
+	std::ofstream out{ filename };
+	if (!out.is_open())
+	{
+		throw std::invalid_argument("Cannot open log file");
+	}
+	std::ranges::stable_sort(events, {}, &DecodedEvent::timeNs);
+	for (const DecodedEvent& event : events)
+	{
+		if (event.eventId == EVENT_SAMPLE)
+		{
+			out << event.threadId << "|" << event.timeNs / 1000000 << "\n";
+		}
+	}
+}
+
+void PrintSummary(const EventLogHeader& header, const std::vector<DecodedEvent>& events)
+{
+	std::vector<ThreadSummary> threads(header.numThreads + 1);
+	for (const DecodedEvent& event : events)
+	{
+		ThreadSummary& thread = threads[event.threadId];
+		++thread.counts[event.eventId];
+		thread.firstNs = std::min(thread.firstNs, event.timeNs);
+		thread.lastNs = std::max(thread.lastNs, event.timeNs);
+		if (event.eventId != EVENT_SAMPLE)
+		{
+			continue;
+		}
+		if (thread.samples > 0)
+		{
+			uint64_t gap = event.timeNs - thread.lastSampleNs;
+			thread.minGapNs = std::min(thread.minGapNs, gap);
+			thread.maxGapNs = std::max(thread.maxGapNs, gap);
+			thread.sumGapNs += gap;
+		}
+		thread.lastSampleNs = event.timeNs;
+		++thread.samples;
+	}
+
+	std::cout << "Clock: " << (header.clockSource == EventClock::SOURCE_TSC ? "invariant TSC" : "monotonic")
+			  << ", " << header.ticksPerNs << " ticks/ns\n";
+	std::cout << "Events: " << events.size() << ", threads: " << header.numThreads << "\n";
+	for (uint32_t id = 1; id <= header.numThreads; ++id)
+	{
+		const ThreadSummary& thread = threads[id];
+		if (thread.counts.empty())
+		{
+			std::cout << "Thread " << id << ": no events\n";
+			continue;
+		}
+		std::cout << "Thread " << id << ": " << (thread.firstNs / 1e6) << " - " << (thread.lastNs / 1e6) << " ms";
+		for (const auto& [eventId, count] : thread.counts)
+		{
+			std::cout << ", " << EventName(eventId) << " " << count;
+		}
+		std::cout << "\n";
+		if (thread.samples > 1)
+		{
+			std::cout << "  sample gap: min " << thread.minGapNs / 1e6 << " ms, mean "
+					  << thread.sumGapNs / 1e6 / (thread.samples - 1) << " ms, max " << thread.maxGapNs / 1e6 << " ms\n";
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc != 2 && argc != 3)
+	{
+		std::cerr << "Usage: " << argv[0] << " <events.bin> [--text=stats.txt]\n";
+		return 1;
+	}
+
+	std::string textFile;
+	if (argc == 3)
+	{
+		std::string option = argv[2];
+		if (!option.starts_with("--text=") || option.size() == std::strlen("--text="))
+		{
+			std::cerr << "Unknown option: " << option << "\n";
+			return 1;
+		}
+		textFile = option.substr(std::strlen("--text="));
+	}
+
+	try
+	{
+		EventLogHeader header;
+		std::vector<DecodedEvent> events = EventLogReader::Read(argv[1], header);
+		PrintSummary(header, events);
+		if (!textFile.empty())
+		{
+			WriteText(textFile, events);
+			std::cout << "Text log saved to: " << textFile << "\n";
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
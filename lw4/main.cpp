@@ -1,24 +1,28 @@
 #include "src/BmpProcessor.h"
+#include "src/Platform.h"
 
+#include <algorithm>
 #include <chrono>
 #include <functional>
 #include <iostream>
 #include <random>
 #include <vector>
-#include <windows.h>
 
 struct InputData
 {
-	std::string inputFile, outputFile, statsFile;
+	std::string inputFile, outputFile, statsFile, traceFile, eventsFile, histogramFile;
 	int numCores, numThreads;
 	std::vector<int> threadPriorities;
+	PinPolicy pinPolicy = PinPolicy::None;
 };
 
 bool ParseCommandLine(int argc, char* argv[], InputData& input)
 {
-	if (argc != 6)
+	if (argc < 6 || argc > 10)
 	{
-		std::cerr << "Usage: " << argv[0] << " <input.bmp> <output.bmp> <stats.txt> <num_cores> <num_threads>\n";
+		std::cerr << "Usage: " << argv[0] << " <input.bmp> <output.bmp> <stats.txt> <num_cores> <num_threads>"
+				  << " [--pin=none|compact|scatter] [--trace=trace.json] [--events=events.bin]"
+				  << " [--hdr=tiles.hdr]\n";
 		return false;
 	}
 	input.inputFile = argv[1];
@@ -27,38 +31,84 @@ bool ParseCommandLine(int argc, char* argv[], InputData& input)
 	input.numCores = std::atoi(argv[4]);
 	input.numThreads = std::atoi(argv[5]);
 
-	if (input.numThreads < 1 || input.numThreads > 16 || input.numCores < 1 || input.numCores > 4)
+	for (int i = 6; i < argc; ++i)
 	{
-		std::cerr << "Invalid parameters: threads in [1,16], cores in [1,4]\n";
+		std::string option = argv[i];
+		if (option.starts_with("--trace=") && option.size() > 8)
+		{
+			input.traceFile = option.substr(8);
+		}
+		else if (option.starts_with("--events=") && option.size() > 9)
+		{
+			input.eventsFile = option.substr(9);
+		}
+		else if (option.starts_with("--hdr=") && option.size() > 6)
+		{
+			input.histogramFile = option.substr(6);
+		}
+		else if (option == "--pin=compact")
+		{
+			input.pinPolicy = PinPolicy::Compact;
+		}
+		else if (option == "--pin=scatter")
+		{
+			input.pinPolicy = PinPolicy::Scatter;
+		}
+		else if (option != "--pin=none")
+		{
+			std::cerr << "Unknown option: " << option << "\n";
+			return false;
+		}
+	}
+
+	int cpuCount = static_cast<int>(Platform::GetProcessCpus().size());
+	if (input.numThreads < 1 || input.numCores < 1 || input.numCores > cpuCount)
+	{
+		std::cerr << "Invalid parameters: threads must be positive, cores in [1," << cpuCount << "]\n";
 		return false;
 	}
 	return true;
 }
 
-bool SetCpuAffinity(int coresAmount)
+// Первые coresAmount из уже разрешённых процессу CPU в порядке политики привязки
+bool SetCpuAffinity(int coresAmount, PinPolicy policy)
 {
-	DWORD_PTR mask = (1ULL << coresAmount) - 1;
-	return SetProcessAffinityMask(GetCurrentProcess(), mask) != 0;
+	std::vector<int> allowed = Platform::GetProcessCpus();
+	std::vector<int> cpus;
+	for (int id : CpuTopology::Get().Order(policy))
+	{
+		if (std::ranges::find(allowed, id) != allowed.end() && static_cast<int>(cpus.size()) < coresAmount)
+		{
+			cpus.push_back(id);
+		}
+	}
+	return static_cast<int>(cpus.size()) == coresAmount && Platform::SetProcessCpus(cpus);
 }
 
 
-void WriteTimings(const std::string& filename)
+// Строки "<номер потока>|<мс от начала blur>" по отметкам прогресса
+void WriteTimings(const std::string& filename, const Tracer& tracer)
 {
 	std::ofstream out{ filename };
 	if (!out.is_open())
 	{
 		throw std::invalid_argument("Cannot open log file");
 	}
-	for (auto [threadId, time] : g_timings)
+	for (const TraceEvent& event : tracer.Merge())
 	{
-		out << threadId << "|" << time << std::endl;
+		if (event.type == TraceEventType::Sample)
+		{
+			out << event.threadId << "|" << tracer.ToNs(event.ticks) / 1000000 << "\n";
+		}
 	}
 }
 
 int main(int argc, char* argv[])
 {
+#ifdef _WIN32
 	SetProcessPriorityBoost(GetCurrentProcess(), true);
-	DWORD start = timeGetTime();
+#endif
+	uint32_t start = Platform::GetTimeMs();
 
 	InputData input;
 
@@ -67,7 +117,7 @@ int main(int argc, char* argv[])
 		return 1;
 	}
 
-	if (!SetCpuAffinity(input.numCores))
+	if (!SetCpuAffinity(input.numCores, input.pinPolicy))
 	{
 		std::cerr << "Failed to set CPU affinity\n";
 		return 1;
@@ -80,14 +130,43 @@ int main(int argc, char* argv[])
 	std::cout << "Pixels size: " << fileData.pixels.size() << "\n";
 	std::cout << "Threads: " << input.numThreads << ", Cores: " << input.numCores << "\n";
 
-	BmpProcessor::BlurImage(fileData, input.numThreads, input.statsFile);
+	Tracer tracer(input.numThreads);
+	BmpProcessor::BlurImage(fileData, input.numThreads, tracer, input.pinPolicy);
 
 	BmpProcessor::Write(input.outputFile, fileData);
 	std::cout << "Output saved to: " << input.outputFile << "\n";
 
-	auto time = timeGetTime() - start;
+	auto time = Platform::GetTimeMs() - start;
 	std::cout << "Spent time: " << time << "\n";
+#ifdef LW_PERF_COUNTERS
+	BmpProcessor::GetPerfReport().Print(std::cout);
+#endif
+
+	LatencyHistogram tileTimes = tracer.GetTileTimes();
+	std::cout << "Tile time: ";
+	tileTimes.PrintPercentiles(std::cout);
+	std::cout << "\n";
 
-	WriteTimings(input.statsFile);
+	WriteTimings(input.statsFile, tracer);
+	if (!input.traceFile.empty())
+	{
+		tracer.WriteChromeTrace(input.traceFile);
+		std::cout << "Trace saved to: " << input.traceFile << "\n";
+	}
+	if (!input.eventsFile.empty())
+	{
+		tracer.WriteEventLog(input.eventsFile);
+		std::cout << "Event log saved to: " << input.eventsFile << "\n";
+	}
+	if (!input.histogramFile.empty())
+	{
+		std::ofstream out{ input.histogramFile };
+		out << tileTimes.Serialize() << "\n";
+		std::cout << "Tile histogram saved to: " << input.histogramFile << "\n";
+	}
+	if (tracer.GetDropped() > 0)
+	{
+		std::cout << "Trace events dropped: " << tracer.GetDropped() << "\n";
+	}
 	return 0;
 }
\ No newline at end of file
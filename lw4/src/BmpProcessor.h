@@ -1,17 +1,19 @@
 #pragma once
+#include "PerfCounters.h"
+#include "Platform.h"
+#include "Trace.h"
+
 #include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <fstream>
 #include <numeric>
 #include <random>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
-#include <windows.h>
-
 
-inline static std::vector<std::pair<short, double>> g_timings{};
-inline static HANDLE g_mutex;
 #pragma pack(push, 1)
 struct FileHeader
 {
@@ -53,7 +55,13 @@ struct ThreadData
 	uint32_t rowStride;
 	std::vector<Square> squares;
 	int threadId;
-	DWORD startTime;
+	int iteration;
+	TraceBuffer* trace;
+#ifdef LW_PERF_COUNTERS
+	PerfThreadSlot* perf;
+#endif
+	int priority;
+	int cpu;
 };
 
 struct FileData
@@ -126,11 +134,14 @@ public:
 		out.close();
 	}
 
-	static void BlurImage(FileData& fileData, int numThreads, const std::string& statsFile)
+	// События потоков пишутся в tracer, созданный на numThreads потоков
+	static void BlurImage(FileData& fileData, int numThreads, Tracer& tracer,
+		PinPolicy pinPolicy = PinPolicy::None)
 	{
-		g_mutex = CreateMutex(nullptr, false, nullptr);
-
-		DWORD globalStart = timeGetTime();
+#ifdef LW_PERF_COUNTERS
+		s_perfReport.Reset(ITERATIONS, numThreads);
+#endif
+		std::vector<int> cpus = Platform::PlanThreadCpus(pinPolicy);
 
 		auto threadSquares = DivideIntoSquares(fileData.GetWidth(), fileData.GetHeight(), numThreads);
 
@@ -138,7 +149,7 @@ public:
 		{
 			auto temp = fileData.pixels;
 
-			std::vector<HANDLE> threads(numThreads);
+			std::vector<std::thread> threads(numThreads);
 			std::vector<ThreadData> threadData(numThreads);
 
 			for (int i = 0; i < numThreads; ++i)
@@ -150,51 +161,91 @@ public:
 				threadData[i].rowStride = fileData.GetRowStride();
 				threadData[i].squares = threadSquares[i];
 				threadData[i].threadId = i + 1;
-				threadData[i].startTime = globalStart;
-
-				threads[i] = CreateThread(nullptr, 0, BlurFunction, &threadData[i], 0, nullptr);
+				threadData[i].iteration = iter + 1;
+				// Буфер переходит к потоку следующей итерации только после join предыдущего
+				threadData[i].trace = &tracer.Buffer(i + 1);
+#ifdef LW_PERF_COUNTERS
+				threadData[i].perf = &s_perfReport.Slot(iter + 1, i + 1);
+#endif
+				// Первый поток выше обычного приоритета, третий - ниже
+				threadData[i].priority = i == 0 ? 1 : i == 2 ? -1 : 0;
+				threadData[i].cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+
+				threads[i] = std::thread(BlurFunction, &threadData[i]);
 			}
 
-			SetThreadPriority(threads[0], ABOVE_NORMAL_PRIORITY_CLASS);
-			SetThreadPriority(threads[2], BELOW_NORMAL_PRIORITY_CLASS);
-			WaitForMultipleObjects(numThreads, threads.data(), TRUE, INFINITE);
-
-			for (HANDLE& thread : threads)
+			for (std::thread& thread : threads)
 			{
-				CloseHandle(thread);
+				thread.join();
 			}
 
 			fileData.pixels = temp;
 		}
 	}
 
+#ifdef LW_PERF_COUNTERS
+	// Счётчики последнего вызова BlurImage
+	static const PerfReport& GetPerfReport() { return s_perfReport; }
+#endif
+
 private:
 	static constexpr int ITERATIONS = 17;
 
-	static DWORD WINAPI BlurFunction(LPVOID lpParam)
+#ifdef LW_PERF_COUNTERS
+	inline static PerfReport s_perfReport;
+#endif
+
+	static void BlurFunction(ThreadData* data)
 	{
-		auto* data = static_cast<ThreadData*>(lpParam);
+		if (data->cpu >= 0)
+		{
+			Platform::PinCurrentThread(data->cpu);
+		}
+		if (data->priority != 0)
+		{
+			Platform::SetCurrentThreadPriority(data->priority);
+		}
 
+#ifdef LW_PERF_COUNTERS
+		// Счётчики открываются после закрепления потока, чтобы не считать само закрепление
+		PerfCounterGroup counters;
+		PerfThreadSlot& perf = *data->perf;
+		perf.available = counters.GetAvailable();
+		perf.tiles.reserve(data->squares.size());
+		PerfValues threadStart = counters.Read();
+#endif
+
+		TraceBuffer& trace = *data->trace;
+		trace.Record(TraceEventType::IterationBegin, data->iteration);
 		for (const Square& square : data->squares)
 		{
+			uint64_t tileBeginTicks = trace.Record(TraceEventType::TileBegin, square.startX, square.startY);
+#ifdef LW_PERF_COUNTERS
+			PerfValues tileStart = counters.Read();
+#endif
 			ApplyBoxBlurToSquare(*data->srcPixels, *data->dstPixels, square,
-				data->width, data->height, data->rowStride, data->threadId,
-				data->startTime);
+				data->width, data->height, data->rowStride, trace);
+#ifdef LW_PERF_COUNTERS
+			perf.tiles.push_back(counters.Read() - tileStart);
+#endif
+			uint64_t tileEndTicks = trace.Record(TraceEventType::TileEnd, square.startX, square.startY);
+			trace.GetTileTimes().Record(EventClock::Get().ToNs(tileEndTicks - tileBeginTicks));
 		}
+		trace.Record(TraceEventType::IterationEnd, data->iteration);
 
-		return 0;
+#ifdef LW_PERF_COUNTERS
+		perf.total = counters.Read() - threadStart;
+#endif
 	}
 
 	static void ApplyBoxBlurToSquare(const std::vector<uint8_t>& src, std::vector<uint8_t>& dst,
-		const Square& square, uint32_t width, uint32_t height, uint32_t rowStride, int threadId, DWORD globalStart)
+		const Square& square, uint32_t width, uint32_t height, uint32_t rowStride, TraceBuffer& trace)
 	{
 		volatile int pixels = 0;
 		for (int y = square.startY; y < square.endY; ++y)
 		{
 			for (int x = square.startX; x < square.endX; ++x)
 			{
-				DWORD currentTime = timeGetTime();
-
 				int r = 0, g = 0, b = 0, count = 0;
 
 				// Box blur 3x3
@@ -225,11 +276,7 @@ private:
 				if (pixels > 20000)
 				{
 					pixels = 0;
-					DWORD elapsedMs = currentTime - globalStart;
-					std::string statsLine = std::to_string(threadId) + "|" + std::to_string(elapsedMs) + "\n";
-					WaitForSingleObject(g_mutex, INFINITE);
-					g_timings.emplace_back(threadId, elapsedMs);
-					ReleaseMutex(g_mutex);
+					trace.Record(TraceEventType::Sample);
 
 					volatile double temp = 0;
 					for (int j = 0; j < 100000; j++)
@@ -0,0 +1,324 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define EVENT_CLOCK_TSC
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#ifdef EVENT_CLOCK_TSC
+#include <intrin.h>
+#endif
+#else
+#include <time.h>
+#ifdef EVENT_CLOCK_TSC
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#endif
+
+// Монотонные часы с разрешением лучше микросекунды. На x86-64 с инвариантным TSC это rdtsc,
+// частота которого один раз калибруется по steady_clock, иначе CLOCK_MONOTONIC_RAW
+// или QueryPerformanceCounter. Отсчёты переводятся во время только при декодировании
+class EventClock
+{
+public:
+	enum Source : uint32_t
+	{
+		SOURCE_TSC,
+		SOURCE_MONOTONIC,
+	};
+
+	static const EventClock& Get()
+	{
+		static const EventClock clock;
+		return clock;
+	}
+
+	uint64_t Now() const
+	{
+#ifdef EVENT_CLOCK_TSC
+		if (m_source == SOURCE_TSC)
+		{
+			return __rdtsc();
+		}
+#endif
+		return ReadMonotonic();
+	}
+
+	Source GetSource() const { return m_source; }
+	double GetTicksPerNs() const { return m_ticksPerNs; }
+	uint64_t ToNs(uint64_t ticks) const { return static_cast<uint64_t>(static_cast<double>(ticks) / m_ticksPerNs); }
+
+private:
+	static constexpr auto CALIBRATION_TIME = std::chrono::milliseconds(20);
+
+	EventClock()
+	{
+#ifdef EVENT_CLOCK_TSC
+		if (HasInvariantTsc())
+		{
+			m_source = SOURCE_TSC;
+			auto start = std::chrono::steady_clock::now();
+			uint64_t startTicks = __rdtsc();
+			std::this_thread::sleep_for(CALIBRATION_TIME);
+			uint64_t endTicks = __rdtsc();
+			auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+			m_ticksPerNs = static_cast<double>(endTicks - startTicks) / elapsed;
+			return;
+		}
+#endif
+		m_source = SOURCE_MONOTONIC;
+#ifdef _WIN32
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		m_ticksPerNs = static_cast<double>(frequency.QuadPart) / 1e9;
+#else
+		m_ticksPerNs = 1.0;
+#endif
+	}
+
+	static uint64_t ReadMonotonic()
+	{
+#ifdef _WIN32
+		LARGE_INTEGER counter;
+		QueryPerformanceCounter(&counter);
+		return static_cast<uint64_t>(counter.QuadPart);
+#else
+		timespec time{};
+		clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+		return static_cast<uint64_t>(time.tv_sec) * 1000000000ull + static_cast<uint64_t>(time.tv_nsec);
+#endif
+	}
+
+#ifdef EVENT_CLOCK_TSC
+	// CPUID 0x80000007, EDX бит 8: частота TSC не зависит от P- и C-состояний
+	static bool HasInvariantTsc()
+	{
+#ifdef _WIN32
+		int info[4];
+		__cpuid(info, 0x80000000);
+		if (static_cast<unsigned>(info[0]) < 0x80000007)
+		{
+			return false;
+		}
+		__cpuid(info, 0x80000007);
+		return (info[3] & (1 << 8)) != 0;
+#else
+		unsigned eax, ebx, ecx, edx;
+		if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+		{
+			return false;
+		}
+		return (edx & (1u << 8)) != 0;
+#endif
+	}
+#endif
+
+	Source m_source = SOURCE_MONOTONIC;
+	double m_ticksPerNs = 1.0;
+};
+
+enum EventId : uint16_t
+{
+	// Отметка, из которых строятся текстовые строки "<поток>|<мс>"
+	EVENT_SAMPLE = 1,
+	EVENT_ITERATION_BEGIN,
+	EVENT_ITERATION_END,
+	EVENT_TILE_BEGIN,
+	EVENT_TILE_END,
+	// Старшие 32 бита дельты следующей записи того же потока, если она не помещается в delta
+	EVENT_DELTA_HIGH = 0xFFFF,
+};
+
+// Файл: заголовок, затем записи фиксированного размера. Записи разных потоков идут блоками
+// вперемешку, время каждой записи - дельта в тактах от предыдущей записи того же потока,
+// первая запись потока отсчитывается от startTicks
+struct EventLogHeader
+{
+	char magic[4] = { 'L', 'W', 'E', 'V' };
+	uint32_t version = 1;
+	double ticksPerNs = 1.0;
+	uint64_t startTicks = 0;
+	uint32_t numThreads = 0;
+	uint32_t clockSource = 0;
+};
+
+struct EventRecord
+{
+	uint16_t threadId;
+	uint16_t eventId;
+	uint32_t delta;
+};
+
+static_assert(sizeof(EventLogHeader) == 32 && sizeof(EventRecord) == 8);
+
+class EventLog;
+
+// Записи одного потока. Пишет только этот поток, без блокировок: запись - чтение часов
+// и 8 байт в буфер. Полный буфер дописывается в конец файла под мьютексом EventLog
+class EventStream
+{
+public:
+	EventStream(EventLog& log, uint16_t threadId, uint64_t startTicks, size_t capacity)
+		: m_log(log)
+		, m_threadId(threadId)
+		, m_lastTicks(startTicks)
+	{
+		m_records.reserve(capacity);
+	}
+
+	void Record(uint16_t eventId) { Record(eventId, EventClock::Get().Now()); }
+
+	void Record(uint16_t eventId, uint64_t ticks)
+	{
+		// Часы потока не идут назад, но на всякий случай дельта не бывает отрицательной
+		uint64_t delta = ticks > m_lastTicks ? ticks - m_lastTicks : 0;
+		m_lastTicks += delta;
+		if (delta > UINT32_MAX)
+		{
+			Push({ m_threadId, EVENT_DELTA_HIGH, static_cast<uint32_t>(delta >> 32) });
+		}
+		Push({ m_threadId, eventId, static_cast<uint32_t>(delta) });
+	}
+
+	void Flush();
+
+private:
+	void Push(const EventRecord& record)
+	{
+		m_records.push_back(record);
+		if (m_records.size() == m_records.capacity())
+		{
+			Flush();
+		}
+	}
+
+	EventLog& m_log;
+	uint16_t m_threadId;
+	uint64_t m_lastTicks;
+	std::vector<EventRecord> m_records;
+};
+
+// Журнал событий в двоичном файле только для дописывания, потоки нумеруются с 1
+class EventLog
+{
+public:
+	static constexpr size_t DEFAULT_BLOCK_RECORDS = 4096;
+
+	// startTicks - начало отсчёта времени записей, по умолчанию момент открытия
+	EventLog(const std::string& filename, int numThreads, size_t blockRecords = DEFAULT_BLOCK_RECORDS,
+		uint64_t startTicks = EventClock::Get().Now())
+		: m_out(filename, std::ios::binary | std::ios::trunc)
+	{
+		if (!m_out)
+		{
+			throw std::runtime_error("Cannot create event log");
+		}
+
+		EventLogHeader header;
+		header.ticksPerNs = EventClock::Get().GetTicksPerNs();
+		header.clockSource = EventClock::Get().GetSource();
+		header.startTicks = startTicks;
+		header.numThreads = static_cast<uint32_t>(numThreads);
+		m_out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		for (int i = 0; i < numThreads; ++i)
+		{
+			m_streams.push_back(std::make_unique<EventStream>(*this, static_cast<uint16_t>(i + 1), header.startTicks, blockRecords));
+		}
+	}
+
+	// Потоки, пишущие в журнал, к этому моменту должны завершиться
+	~EventLog()
+	{
+		Close();
+	}
+
+	EventLog(const EventLog&) = delete;
+	EventLog& operator=(const EventLog&) = delete;
+
+	EventStream& Stream(int threadId) { return *m_streams[threadId - 1]; }
+
+	void Close()
+	{
+		for (auto& stream : m_streams)
+		{
+			stream->Flush();
+		}
+		m_out.flush();
+	}
+
+	void Append(const std::vector<EventRecord>& records)
+	{
+		std::lock_guard lock(m_mutex);
+		m_out.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(EventRecord)));
+	}
+
+private:
+	std::ofstream m_out;
+	std::mutex m_mutex;
+	std::vector<std::unique_ptr<EventStream>> m_streams;
+};
+
+inline void EventStream::Flush()
+{
+	if (!m_records.empty())
+	{
+		m_log.Append(m_records);
+		m_records.clear();
+	}
+}
+
+struct DecodedEvent
+{
+	uint16_t threadId;
+	uint16_t eventId;
+	// От startTicks журнала
+	uint64_t timeNs;
+};
+
+// Восстанавливает абсолютное время записей, порядок записей файла сохраняется
+class EventLogReader
+{
+public:
+	static std::vector<DecodedEvent> Read(const std::string& filename, EventLogHeader& header)
+	{
+		std::ifstream in(filename, std::ios::binary);
+		if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::string(header.magic, 4) != "LWEV" || header.version != 1)
+		{
+			throw std::runtime_error("Not an event log");
+		}
+
+		std::vector<uint64_t> elapsed(header.numThreads + 1, 0);
+		std::vector<uint64_t> high(header.numThreads + 1, 0);
+		std::vector<DecodedEvent> events;
+		EventRecord record;
+		while (in.read(reinterpret_cast<char*>(&record), sizeof(record)))
+		{
+			if (record.threadId == 0 || record.threadId > header.numThreads)
+			{
+				throw std::runtime_error("Corrupted event log: unknown thread");
+			}
+			if (record.eventId == EVENT_DELTA_HIGH)
+			{
+				high[record.threadId] = static_cast<uint64_t>(record.delta) << 32;
+				continue;
+			}
+			elapsed[record.threadId] += high[record.threadId] | record.delta;
+			high[record.threadId] = 0;
+			events.push_back({ record.threadId, record.eventId,
+				static_cast<uint64_t>(static_cast<double>(elapsed[record.threadId]) / header.ticksPerNs) });
+		}
+		return events;
+	}
+};
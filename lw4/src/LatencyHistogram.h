@@ -0,0 +1,222 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// Гистограмма задержек с логарифмически-линейными корзинами, как HdrHistogram: до 256 нс корзина
+// на каждую наносекунду, дальше каждая степень двойки делится на 128 корзин, так что
+// относительная ошибка перцентиля не больше 1/128. Значения больше MAX_VALUE_NS сводятся к нему.
+// Пишет в гистограмму один поток без блокировок, а читать и сливать её можно в любой момент
+class LatencyHistogram
+{
+public:
+	static constexpr int SUB_BUCKET_BITS = 8;
+	static constexpr int VALUE_BITS = 40;
+	static constexpr uint64_t MAX_VALUE_NS = (1ull << VALUE_BITS) - 1;
+	static constexpr int BUCKET_COUNT = (1 << SUB_BUCKET_BITS) + (VALUE_BITS - SUB_BUCKET_BITS) * (1 << (SUB_BUCKET_BITS - 1));
+
+	LatencyHistogram()
+		: m_counts(std::make_unique<std::atomic<uint64_t>[]>(BUCKET_COUNT))
+	{
+	}
+
+	LatencyHistogram(const LatencyHistogram& other)
+		: LatencyHistogram()
+	{
+		Merge(other);
+	}
+
+	LatencyHistogram& operator=(const LatencyHistogram& other)
+	{
+		if (this != &other)
+		{
+			Reset();
+			Merge(other);
+		}
+		return *this;
+	}
+
+	// Вызывается только потоком-владельцем
+	void Record(uint64_t valueNs)
+	{
+		valueNs = std::min(valueNs, MAX_VALUE_NS);
+		Increment(m_counts[BucketOf(valueNs)], 1);
+		Increment(m_total, 1);
+		Increment(m_sum, valueNs);
+		if (valueNs < m_min.load(std::memory_order_relaxed))
+		{
+			m_min.store(valueNs, std::memory_order_relaxed);
+		}
+		if (valueNs > m_max.load(std::memory_order_relaxed))
+		{
+			m_max.store(valueNs, std::memory_order_relaxed);
+		}
+	}
+
+	// Прибавляет счётчики other, например гистограммы другого потока или процесса.
+	// Сама гистограмма при этом не должна писаться другим потоком
+	void Merge(const LatencyHistogram& other)
+	{
+		for (int i = 0; i < BUCKET_COUNT; ++i)
+		{
+			Increment(m_counts[i], other.m_counts[i].load(std::memory_order_relaxed));
+		}
+		Increment(m_total, other.GetCount());
+		Increment(m_sum, other.m_sum.load(std::memory_order_relaxed));
+		m_min.store(std::min(GetMin(), other.GetMin()), std::memory_order_relaxed);
+		m_max.store(std::max(GetMax(), other.GetMax()), std::memory_order_relaxed);
+	}
+
+	void Reset()
+	{
+		for (int i = 0; i < BUCKET_COUNT; ++i)
+		{
+			m_counts[i].store(0, std::memory_order_relaxed);
+		}
+		m_total.store(0, std::memory_order_relaxed);
+		m_sum.store(0, std::memory_order_relaxed);
+		m_min.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+		m_max.store(0, std::memory_order_relaxed);
+	}
+
+	uint64_t GetCount() const { return m_total.load(std::memory_order_relaxed); }
+	uint64_t GetMin() const { return m_min.load(std::memory_order_relaxed); }
+	uint64_t GetMax() const { return m_max.load(std::memory_order_relaxed); }
+
+	double GetMean() const
+	{
+		uint64_t count = GetCount();
+		return count > 0 ? static_cast<double>(m_sum.load(std::memory_order_relaxed)) / count : 0.0;
+	}
+
+	// Наибольшее значение корзины, в которую попадает перцентиль, но не больше максимума
+	uint64_t GetPercentile(double percent) const
+	{
+		uint64_t count = GetCount();
+		if (count == 0)
+		{
+			return 0;
+		}
+		auto rank = static_cast<uint64_t>(std::clamp(percent / 100.0 * count + 0.5, 1.0, static_cast<double>(count)));
+		uint64_t seen = 0;
+		for (int i = 0; i < BUCKET_COUNT; ++i)
+		{
+			seen += m_counts[i].load(std::memory_order_relaxed);
+			if (seen >= rank)
+			{
+				return std::clamp(HighestOf(i), GetMin(), GetMax());
+			}
+		}
+		return GetMax();
+	}
+
+	// "min=.. p50=.. p90=.. p99=.. p99.9=.. max=.. мкс"
+	void PrintPercentiles(std::ostream& out) const
+	{
+		auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+		out << "count " << GetCount() << ", min " << us(GetCount() > 0 ? GetMin() : 0) << ", p50 " << us(GetPercentile(50))
+			<< ", p90 " << us(GetPercentile(90)) << ", p99 " << us(GetPercentile(99)) << ", p99.9 " << us(GetPercentile(99.9))
+			<< ", max " << us(GetMax()) << " us";
+	}
+
+	// Одна строка: "hdr1 <count> <sum> <min> <max>" и пары "<корзина>:<счётчик>" непустых корзин
+	std::string Serialize() const
+	{
+		std::ostringstream out;
+		out << "hdr1 " << GetCount() << " " << m_sum.load(std::memory_order_relaxed) << " " << GetMin() << " " << GetMax();
+		for (int i = 0; i < BUCKET_COUNT; ++i)
+		{
+			uint64_t count = m_counts[i].load(std::memory_order_relaxed);
+			if (count > 0)
+			{
+				out << " " << i << ":" << count;
+			}
+		}
+		return out.str();
+	}
+
+	static LatencyHistogram Deserialize(const std::string& line)
+	{
+		std::istringstream in(line);
+		std::string magic;
+		uint64_t total = 0, sum = 0, min = 0, max = 0;
+		if (!(in >> magic >> total >> sum >> min >> max) || magic != "hdr1")
+		{
+			throw std::runtime_error("Invalid histogram");
+		}
+
+		LatencyHistogram histogram;
+		histogram.m_total.store(total, std::memory_order_relaxed);
+		histogram.m_sum.store(sum, std::memory_order_relaxed);
+		histogram.m_min.store(min, std::memory_order_relaxed);
+		histogram.m_max.store(max, std::memory_order_relaxed);
+
+		uint64_t bucketTotal = 0;
+		std::string pair;
+		while (in >> pair)
+		{
+			size_t colon = pair.find(':');
+			int bucket = colon == std::string::npos ? -1 : std::stoi(pair.substr(0, colon));
+			if (bucket < 0 || bucket >= BUCKET_COUNT)
+			{
+				throw std::runtime_error("Invalid histogram bucket");
+			}
+			uint64_t count = std::stoull(pair.substr(colon + 1));
+			histogram.m_counts[bucket].store(count, std::memory_order_relaxed);
+			bucketTotal += count;
+		}
+		if (bucketTotal != total)
+		{
+			throw std::runtime_error("Histogram counts do not add up");
+		}
+		return histogram;
+	}
+
+private:
+	static constexpr uint64_t SUB_BUCKETS = 1ull << SUB_BUCKET_BITS;
+	static constexpr uint64_t HALF_SUB_BUCKETS = SUB_BUCKETS / 2;
+
+	// Один писатель, поэтому хватает чтения и записи без атомарного сложения
+	static void Increment(std::atomic<uint64_t>& counter, uint64_t value)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+
+	// Старшие SUB_BUCKET_BITS бит значения: первые SUB_BUCKETS корзин точные, затем по
+	// HALF_SUB_BUCKETS корзин на каждый следующий бит
+	static int BucketOf(uint64_t value)
+	{
+		int bits = std::bit_width(value);
+		if (bits <= SUB_BUCKET_BITS)
+		{
+			return static_cast<int>(value);
+		}
+		int shift = bits - SUB_BUCKET_BITS;
+		return static_cast<int>(SUB_BUCKETS + (shift - 1) * HALF_SUB_BUCKETS + ((value >> shift) - HALF_SUB_BUCKETS));
+	}
+
+	static uint64_t HighestOf(int bucket)
+	{
+		if (bucket < static_cast<int>(SUB_BUCKETS))
+		{
+			return static_cast<uint64_t>(bucket);
+		}
+		int shift = static_cast<int>((bucket - SUB_BUCKETS) / HALF_SUB_BUCKETS) + 1;
+		uint64_t top = HALF_SUB_BUCKETS + (bucket - SUB_BUCKETS) % HALF_SUB_BUCKETS;
+		return ((top + 1) << shift) - 1;
+	}
+
+	std::unique_ptr<std::atomic<uint64_t>[]> m_counts;
+	std::atomic<uint64_t> m_total{ 0 };
+	std::atomic<uint64_t> m_sum{ 0 };
+	std::atomic<uint64_t> m_min{ std::numeric_limits<uint64_t>::max() };
+	std::atomic<uint64_t> m_max{ 0 };
+};
@@ -0,0 +1,252 @@
+#pragma once
+// Аппаратные счётчики собираются только при сборке с LW_PERF_COUNTERS, иначе файл пуст
+#ifdef LW_PERF_COUNTERS
+
+#ifndef __linux__
+#error "LW_PERF_COUNTERS requires Linux perf_event_open"
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+enum PerfEvent
+{
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_LLC_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_EVENT_COUNT,
+};
+
+struct PerfValues
+{
+	std::array<uint64_t, PERF_EVENT_COUNT> counts{};
+
+	PerfValues& operator+=(const PerfValues& other)
+	{
+		for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+		{
+			counts[i] += other.counts[i];
+		}
+		return *this;
+	}
+
+	PerfValues operator-(const PerfValues& other) const
+	{
+		PerfValues result;
+		for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+		{
+			result.counts[i] = counts[i] - other.counts[i];
+		}
+		return result;
+	}
+
+	double GetIpc() const
+	{
+		return counts[PERF_CYCLES] > 0 ? static_cast<double>(counts[PERF_INSTRUCTIONS]) / counts[PERF_CYCLES] : 0.0;
+	}
+};
+
+// Группа счётчиков вызывающего потока, только пользовательский режим, чтобы хватало
+// perf_event_paranoid <= 2. Недоступные события (например, LLC в виртуальной машине) пропускаются
+class PerfCounterGroup
+{
+public:
+	PerfCounterGroup()
+	{
+		static constexpr std::array<std::pair<uint32_t, uint64_t>, PERF_EVENT_COUNT> EVENTS{ {
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+		} };
+
+		for (int event = 0; event < PERF_EVENT_COUNT; ++event)
+		{
+			perf_event_attr attr{};
+			attr.size = sizeof(attr);
+			attr.type = EVENTS[event].first;
+			attr.config = EVENTS[event].second;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+			int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, m_fds.empty() ? -1 : m_fds.front(), 0));
+			if (fd >= 0)
+			{
+				m_fds.push_back(fd);
+				m_events.push_back(event);
+			}
+		}
+	}
+
+	~PerfCounterGroup()
+	{
+		for (int fd : m_fds)
+		{
+			close(fd);
+		}
+	}
+
+	PerfCounterGroup(const PerfCounterGroup&) = delete;
+	PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+	// Маска открытых событий, бит i соответствует PerfEvent i
+	uint32_t GetAvailable() const
+	{
+		uint32_t mask = 0;
+		for (int event : m_events)
+		{
+			mask |= 1u << event;
+		}
+		return mask;
+	}
+
+	// Значения с поправкой на мультиплексирование, если группа была вытеснена с PMU
+	PerfValues Read() const
+	{
+		PerfValues values;
+		if (m_fds.empty())
+		{
+			return values;
+		}
+
+		std::array<uint64_t, 3 + PERF_EVENT_COUNT> buffer{};
+		if (read(m_fds.front(), buffer.data(), sizeof(buffer)) < static_cast<ssize_t>((3 + m_fds.size()) * sizeof(uint64_t)))
+		{
+			return values;
+		}
+		uint64_t enabled = buffer[1];
+		uint64_t running = buffer[2];
+		for (size_t i = 0; i < m_events.size(); ++i)
+		{
+			uint64_t count = buffer[3 + i];
+			if (running > 0 && running < enabled)
+			{
+				count = static_cast<uint64_t>(static_cast<double>(count) * enabled / running);
+			}
+			values.counts[m_events[i]] = count;
+		}
+		return values;
+	}
+
+private:
+	std::vector<int> m_fds;
+	std::vector<int> m_events;
+};
+
+// Счётчики одного потока за одну итерацию: весь BlurFunction и каждая его плитка
+struct PerfThreadSlot
+{
+	uint32_t available = 0;
+	PerfValues total;
+	std::vector<PerfValues> tiles;
+};
+
+// Слоты заполняются каждый своим потоком, а печатаются после join
+class PerfReport
+{
+public:
+	void Reset(int iterations, int numThreads)
+	{
+		m_numThreads = numThreads;
+		m_slots.assign(static_cast<size_t>(iterations) * numThreads, {});
+	}
+
+	// iteration и threadId начинаются с 1
+	PerfThreadSlot& Slot(int iteration, int threadId)
+	{
+		return m_slots[static_cast<size_t>(iteration - 1) * m_numThreads + threadId - 1];
+	}
+
+	void Print(std::ostream& out) const
+	{
+		uint32_t available = 0;
+		for (const PerfThreadSlot& slot : m_slots)
+		{
+			available |= slot.available;
+		}
+		if (available == 0)
+		{
+			out << "Perf counters unavailable, check /proc/sys/kernel/perf_event_paranoid\n";
+			return;
+		}
+
+		std::ios_base::fmtflags flags = out.flags();
+		std::streamsize precision = out.precision();
+		int iterations = m_numThreads > 0 ? static_cast<int>(m_slots.size()) / m_numThreads : 0;
+		out << "Perf counters (user space):\n"
+			<< std::setw(10) << "" << std::setw(16) << "cycles" << std::setw(16) << "instructions" << std::setw(7) << "IPC"
+			<< std::setw(14) << "LLC-misses" << std::setw(15) << "branch-misses" << "  tile IPC min..max\n";
+
+		std::vector<PerfValues> threadTotals(m_numThreads);
+		for (int iter = 1; iter <= iterations; ++iter)
+		{
+			PerfValues total;
+			double minIpc = std::numeric_limits<double>::max();
+			double maxIpc = 0;
+			for (int thread = 1; thread <= m_numThreads; ++thread)
+			{
+				const PerfThreadSlot& slot = m_slots[static_cast<size_t>(iter - 1) * m_numThreads + thread - 1];
+				total += slot.total;
+				threadTotals[thread - 1] += slot.total;
+				for (const PerfValues& tile : slot.tiles)
+				{
+					minIpc = std::min(minIpc, tile.GetIpc());
+					maxIpc = std::max(maxIpc, tile.GetIpc());
+				}
+			}
+			PrintRow(out, "iter " + std::to_string(iter), total, available);
+			if (maxIpc > 0)
+			{
+				out << "  " << minIpc << ".." << maxIpc;
+			}
+			out << "\n";
+		}
+
+		for (int thread = 1; thread <= m_numThreads; ++thread)
+		{
+			PrintRow(out, "thread " + std::to_string(thread), threadTotals[thread - 1], available);
+			out << "\n";
+		}
+		out.flags(flags);
+		out.precision(precision);
+	}
+
+private:
+	static void PrintRow(std::ostream& out, const std::string& name, const PerfValues& values, uint32_t available)
+	{
+		auto count = [&](PerfEvent event, int width) {
+			if (available & (1u << event))
+			{
+				out << std::setw(width) << values.counts[event];
+			}
+			else
+			{
+				out << std::setw(width) << "-";
+			}
+		};
+
+		out << std::left << std::setw(10) << name << std::right;
+		count(PERF_CYCLES, 16);
+		count(PERF_INSTRUCTIONS, 16);
+		out << std::fixed << std::setprecision(2) << std::setw(7) << values.GetIpc();
+		count(PERF_LLC_MISSES, 14);
+		count(PERF_BRANCH_MISSES, 15);
+	}
+
+	int m_numThreads = 0;
+	std::vector<PerfThreadSlot> m_slots;
+};
+
+#endif
@@ -0,0 +1,213 @@
+#pragma once
+#include "EventLog.h"
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+enum class TraceEventType : uint16_t
+{
+	IterationBegin,
+	IterationEnd,
+	TileBegin,
+	TileEnd,
+	// Отметка прогресса, из которых строится файл статистики WriteTimings
+	Sample,
+};
+
+// Для плиток a и b - левый верхний угол, для итераций a - номер итерации
+// ticks - такты EventClock от начала Tracer
+struct TraceEvent
+{
+	uint64_t ticks;
+	int32_t a;
+	int32_t b;
+	uint16_t threadId;
+	TraceEventType type;
+};
+
+// Кольцевой буфер событий одного потока. Пишет в него только свой поток, без блокировок,
+// а читается он после join, так что синхронизация не нужна. При переполнении
+// затираются самые старые события
+class alignas(64) TraceBuffer
+{
+public:
+	TraceBuffer(uint16_t threadId, size_t capacity, uint64_t startTicks)
+		: m_events(std::bit_ceil(capacity))
+		, m_mask(m_events.size() - 1)
+		, m_threadId(threadId)
+		, m_startTicks(startTicks)
+	{
+	}
+
+	// Возвращает время события в тактах от начала Tracer
+	uint64_t Record(TraceEventType type, int32_t a = 0, int32_t b = 0)
+	{
+		uint64_t ticks = EventClock::Get().Now() - m_startTicks;
+		m_events[m_head & m_mask] = { ticks, a, b, m_threadId, type };
+		++m_head;
+		return ticks;
+	}
+
+	// Длительности плиток потока в нс, в отличие от событий не затираются
+	LatencyHistogram& GetTileTimes() { return m_tileTimes; }
+	const LatencyHistogram& GetTileTimes() const { return m_tileTimes; }
+
+	uint64_t GetDropped() const { return m_head > m_events.size() ? m_head - m_events.size() : 0; }
+
+	// События в порядке записи
+	void AppendTo(std::vector<TraceEvent>& events) const
+	{
+		for (uint64_t i = GetDropped(); i < m_head; ++i)
+		{
+			events.push_back(m_events[i & m_mask]);
+		}
+	}
+
+private:
+	std::vector<TraceEvent> m_events;
+	uint64_t m_mask;
+	uint64_t m_head = 0;
+	uint16_t m_threadId;
+	uint64_t m_startTicks;
+	LatencyHistogram m_tileTimes;
+};
+
+// Буферы всех потоков одного прогона, время событий считается от создания Tracer
+class Tracer
+{
+public:
+	static constexpr size_t DEFAULT_CAPACITY = 1 << 16;
+
+	explicit Tracer(int numThreads, size_t capacity = DEFAULT_CAPACITY)
+	{
+		for (int i = 0; i < numThreads; ++i)
+		{
+			m_buffers.push_back(std::make_unique<TraceBuffer>(static_cast<uint16_t>(i + 1), capacity, m_startTicks));
+		}
+	}
+
+	// threadId начинается с 1, как в файле статистики
+	TraceBuffer& Buffer(int threadId) { return *m_buffers[threadId - 1]; }
+
+	uint64_t ToNs(uint64_t ticks) const { return EventClock::Get().ToNs(ticks); }
+
+	// Длительности плиток всех потоков, после завершения потоков
+	LatencyHistogram GetTileTimes() const
+	{
+		LatencyHistogram tileTimes;
+		for (const auto& buffer : m_buffers)
+		{
+			tileTimes.Merge(buffer->GetTileTimes());
+		}
+		return tileTimes;
+	}
+
+	uint64_t GetDropped() const
+	{
+		uint64_t dropped = 0;
+		for (const auto& buffer : m_buffers)
+		{
+			dropped += buffer->GetDropped();
+		}
+		return dropped;
+	}
+
+	// Слияние после завершения потоков, события упорядочены по времени
+	std::vector<TraceEvent> Merge() const
+	{
+		std::vector<TraceEvent> events;
+		for (const auto& buffer : m_buffers)
+		{
+			buffer->AppendTo(events);
+		}
+		std::ranges::stable_sort(events, {}, &TraceEvent::ticks);
+		return events;
+	}
+
+	// Формат Chrome trace event, открывается в chrome://tracing и Perfetto
+	void WriteChromeTrace(const std::string& filename) const
+	{
+		std::ofstream out{ filename };
+		if (!out.is_open())
+		{
+			throw std::invalid_argument("Cannot open trace file");
+		}
+
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		for (size_t i = 0; i < m_buffers.size(); ++i)
+		{
+			out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i + 1
+				<< ",\"args\":{\"name\":\"Thread " << i + 1 << "\"}},\n";
+		}
+
+		std::vector<TraceEvent> events = Merge();
+		for (size_t i = 0; i < events.size(); ++i)
+		{
+			const TraceEvent& event = events[i];
+			uint64_t timeNs = ToNs(event.ticks);
+			out << "{\"pid\":1,\"tid\":" << event.threadId << ",\"ts\":" << timeNs / 1000 << "." << timeNs / 100 % 10;
+			switch (event.type)
+			{
+			case TraceEventType::IterationBegin:
+			case TraceEventType::IterationEnd:
+				out << ",\"name\":\"iteration " << event.a << "\",\"ph\":\""
+					<< (event.type == TraceEventType::IterationBegin ? "B" : "E") << "\"";
+				break;
+			case TraceEventType::TileBegin:
+			case TraceEventType::TileEnd:
+				out << ",\"name\":\"tile\",\"ph\":\"" << (event.type == TraceEventType::TileBegin ? "B" : "E")
+					<< "\",\"args\":{\"x\":" << event.a << ",\"y\":" << event.b << "}";
+				break;
+			case TraceEventType::Sample:
+				out << ",\"name\":\"sample\",\"ph\":\"i\",\"s\":\"t\"";
+				break;
+			}
+			out << "}" << (i + 1 < events.size() ? "," : "") << "\n";
+		}
+		out << "]}\n";
+	}
+
+	// Двоичный журнал EventLog, события каждого потока в порядке записи, без координат плиток
+	void WriteEventLog(const std::string& filename) const
+	{
+		EventLog log(filename, static_cast<int>(m_buffers.size()), EventLog::DEFAULT_BLOCK_RECORDS, m_startTicks);
+		for (size_t i = 0; i < m_buffers.size(); ++i)
+		{
+			std::vector<TraceEvent> events;
+			m_buffers[i]->AppendTo(events);
+			EventStream& stream = log.Stream(static_cast<int>(i + 1));
+			for (const TraceEvent& event : events)
+			{
+				stream.Record(ToEventId(event.type), m_startTicks + event.ticks);
+			}
+		}
+	}
+
+private:
+	static uint16_t ToEventId(TraceEventType type)
+	{
+		switch (type)
+		{
+		case TraceEventType::IterationBegin:
+			return EVENT_ITERATION_BEGIN;
+		case TraceEventType::IterationEnd:
+			return EVENT_ITERATION_END;
+		case TraceEventType::TileBegin:
+			return EVENT_TILE_BEGIN;
+		case TraceEventType::TileEnd:
+			return EVENT_TILE_END;
+		default:
+			return EVENT_SAMPLE;
+		}
+	}
+
+	uint64_t m_startTicks = EventClock::Get().Now();
+	std::vector<std::unique_ptr<TraceBuffer>> m_buffers;
+};
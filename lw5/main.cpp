@@ -1,8 +1,15 @@
 #include "tchar.h"
+#include "src/Account.h"
+#include "src/LatencyHistogram.h"
+#include "src/WriteAheadLog.h"
 
+#include <chrono>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
 #include <format>
 #include <windows.h>
 
@@ -10,9 +17,20 @@
 // HANDLE GlobalMutex = nullptr;
 CRITICAL_SECTION GlobalCriticalSection;
 
+constexpr int THREADS_COUNT = 50;
+// С --lockfree баланс живёт в разделяемой памяти с этим именем, общей для запущенных процессов
+constexpr LPCSTR ACCOUNT_NAME = "Lw5Account";
+// С --wal каждая операция на диске до возврата, balance.txt - контрольная точка этого журнала
+constexpr LPCSTR WAL_FILE = "balance.wal";
+
 struct threadData
 {
 	int money;
+	// Оба nullptr - баланс в balance.txt
+	Account* account;
+	DurableAccount* durable;
+	// Длительность операции потока, после завершения потоков сливается по видам операций
+	LatencyHistogram duration;
 };
 
 int ReadFromFile()
@@ -93,23 +111,296 @@ void Withdraw(int money)
 	// LeaveCriticalSection(&GlobalCriticalSection);
 }
 
+// Account и DurableAccount: проверка и списание в Withdraw атомарны, поэтому задержка между
+// ними ничего не ломает и не нужна, а balance.txt обновляют они сами
+template <typename TAccount>
+void DepositToAccount(TAccount& account, int money)
+{
+	int64_t balance = account.Deposit(money);
+	PrintWithTime(GetCurrentProcessId(), "Balance after deposit", static_cast<int>(balance));
+}
+
+template <typename TAccount>
+void WithdrawFromAccount(TAccount& account, int money)
+{
+	int64_t balance;
+	if (!account.Withdraw(money, balance))
+	{
+		PrintWithTime(GetCurrentProcessId(), std::format("Cannot withdraw money, balance lower than {}", money));
+	}
+	else
+	{
+		PrintWithTime(GetCurrentProcessId(), "Balance after withdraw", static_cast<int>(balance));
+	}
+}
+
+uint64_t ElapsedNs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
 DWORD WINAPI DoDeposit(CONST LPVOID lpParameter)
 {
 	auto* data = static_cast<threadData*>(lpParameter);
-	Deposit(data->money);
+	auto start = std::chrono::steady_clock::now();
+	if (data->account != nullptr)
+	{
+		DepositToAccount(*data->account, data->money);
+	}
+	else if (data->durable != nullptr)
+	{
+		DepositToAccount(*data->durable, data->money);
+	}
+	else
+	{
+		Deposit(data->money);
+	}
+	data->duration.Record(ElapsedNs(start));
 	ExitThread(0);
 }
 
 DWORD WINAPI DoWithdraw(CONST LPVOID lpParameter)
 {
 	auto* data = static_cast<threadData*>(lpParameter);
-	Withdraw(data->money);
+	auto start = std::chrono::steady_clock::now();
+	if (data->account != nullptr)
+	{
+		WithdrawFromAccount(*data->account, data->money);
+	}
+	else if (data->durable != nullptr)
+	{
+		WithdrawFromAccount(*data->durable, data->money);
+	}
+	else
+	{
+		Withdraw(data->money);
+	}
+	data->duration.Record(ElapsedNs(start));
 	ExitThread(0);
 }
 
-int main()
+// Перцентили на экран и строки Serialize в latency_<pid>.hdr, чтобы слить результаты процессов
+void PrintLatencies(int processId, const LatencyHistogram& deposits, const LatencyHistogram& withdrawals)
 {
-	auto* handles = new HANDLE[50];
+	std::cout << "Deposit time: ";
+	deposits.PrintPercentiles(std::cout);
+	std::cout << "\nWithdraw time: ";
+	withdrawals.PrintPercentiles(std::cout);
+	std::cout << "\n";
+
+	std::ofstream histogramFile(std::format("latency_{}.hdr", processId));
+	histogramFile << "deposit " << deposits.Serialize() << "\n";
+	histogramFile << "withdraw " << withdrawals.Serialize() << "\n";
+}
+
+// Пропускная способность операций без вывода и без Sleep: прежние варианты с balance.txt
+// под мьютексом и под критической секцией (results/) против Account и DurableAccount
+constexpr int BENCH_OPERATIONS_PER_THREAD = 1000;
+constexpr int BENCH_THREADS[] = { 2, 8, 50 };
+constexpr LPCSTR BENCH_CHECKPOINT_FILE = "bench_balance.txt";
+constexpr LPCSTR BENCH_WAL_FILE = "bench_balance.wal";
+
+enum class BenchMode
+{
+	Mutex,
+	CriticalSection,
+	LockFree,
+	Wal,
+};
+
+struct BenchThreadData
+{
+	BenchMode mode;
+	HANDLE mutex;
+	Account* account;
+	DurableAccount* durable;
+	int64_t deposited;
+	int64_t withdrawn;
+	LatencyHistogram latencies;
+};
+
+template <typename TAccount>
+void BenchAccountOperation(TAccount& account, bool deposit, int money, BenchThreadData& data)
+{
+	int64_t balance;
+	if (deposit)
+	{
+		account.Deposit(money);
+		data.deposited += money;
+	}
+	else if (account.Withdraw(money, balance))
+	{
+		data.withdrawn += money;
+	}
+}
+
+DWORD WINAPI BenchThreadFunction(LPVOID lpParameter)
+{
+	auto* data = static_cast<BenchThreadData*>(lpParameter);
+	for (int i = 0; i < BENCH_OPERATIONS_PER_THREAD; i++)
+	{
+		bool deposit = i % 2 == 0;
+		int money = deposit ? 230 : 1000;
+		auto start = std::chrono::steady_clock::now();
+		if (data->mode == BenchMode::LockFree)
+		{
+			BenchAccountOperation(*data->account, deposit, money, *data);
+		}
+		else if (data->mode == BenchMode::Wal)
+		{
+			BenchAccountOperation(*data->durable, deposit, money, *data);
+		}
+		else
+		{
+			if (data->mode == BenchMode::Mutex)
+			{
+				WaitForSingleObject(data->mutex, INFINITE);
+			}
+			else
+			{
+				EnterCriticalSection(&GlobalCriticalSection);
+			}
+
+			int balance = GetBalance();
+			if (deposit)
+			{
+				WriteToFile(balance + money);
+				data->deposited += money;
+			}
+			else if (balance >= money)
+			{
+				WriteToFile(balance - money);
+				data->withdrawn += money;
+			}
+
+			if (data->mode == BenchMode::Mutex)
+			{
+				ReleaseMutex(data->mutex);
+			}
+			else
+			{
+				LeaveCriticalSection(&GlobalCriticalSection);
+			}
+		}
+		data->latencies.Record(ElapsedNs(start));
+	}
+	return 0;
+}
+
+void RunBenchmark(int threadsCount, BenchMode mode)
+{
+	HANDLE mutex = CreateMutex(nullptr, false, nullptr);
+	Account account;
+	WriteToFile(0);
+	DeleteFileA(BENCH_CHECKPOINT_FILE);
+	DeleteFileA(BENCH_WAL_FILE);
+	auto durable = mode == BenchMode::Wal ? std::make_unique<DurableAccount>(BENCH_CHECKPOINT_FILE, BENCH_WAL_FILE) : nullptr;
+
+	std::vector<BenchThreadData> threadData(threadsCount);
+	std::vector<HANDLE> handles(threadsCount);
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < threadsCount; i++)
+	{
+		threadData[i].mode = mode;
+		threadData[i].mutex = mutex;
+		threadData[i].account = &account;
+		threadData[i].durable = durable.get();
+		handles[i] = CreateThread(nullptr, 0, BenchThreadFunction, &threadData[i], 0, nullptr);
+	}
+	WaitForMultipleObjects(threadsCount, handles.data(), true, INFINITE);
+	double seconds = ElapsedNs(start) / 1e9;
+
+	// Итоговый баланс должен совпасть с суммой успешных операций
+	LatencyHistogram latencies;
+	int64_t expected = 0;
+	for (int i = 0; i < threadsCount; i++)
+	{
+		CloseHandle(handles[i]);
+		latencies.Merge(threadData[i].latencies);
+		expected += threadData[i].deposited - threadData[i].withdrawn;
+	}
+	int64_t balance = mode == BenchMode::LockFree ? account.GetBalance() : GetBalance();
+	uint64_t commits = 0, syncs = 0;
+	if (durable)
+	{
+		commits = durable->GetLog().GetCommits();
+		syncs = durable->GetLog().GetSyncs();
+		// Баланс, восстановленный с диска заново
+		durable->Close();
+		durable.reset();
+		balance = DurableAccount(BENCH_CHECKPOINT_FILE, BENCH_WAL_FILE).GetBalance();
+	}
+
+	auto us = [&](double percent) { return latencies.GetPercentile(percent) / 1000.0; };
+	std::cout << std::format("{:>7} {:>16} {:>12.0f} {:>10.2f} {:>10.2f} {:>10.2f} {:>10}\n", threadsCount,
+		mode == BenchMode::Mutex ? "mutex" : mode == BenchMode::CriticalSection ? "critical section" : mode == BenchMode::LockFree ? "lock-free" : "wal",
+		latencies.GetCount() / seconds, us(50), us(99), us(99.9), balance == expected ? "yes" : "no");
+	if (syncs > 0)
+	{
+		std::cout << std::format("{:>24} {} durable operations in {} syncs, {:.1f} per sync\n", "", commits, syncs,
+			static_cast<double>(commits) / syncs);
+	}
+
+	CloseHandle(mutex);
+}
+
+int main(int argc, char* argv[])
+{
+	std::string mode = argc == 2 ? argv[1] : "";
+	bool wal = mode == "--wal" || mode.starts_with("--wal=");
+	std::chrono::microseconds maxDelay = WriteAheadLog::DEFAULT_MAX_DELAY;
+	if (mode.starts_with("--wal="))
+	{
+		int delayUs = std::atoi(mode.c_str() + 6);
+		wal = delayUs >= 0;
+		maxDelay = std::chrono::microseconds(delayUs);
+	}
+	if (argc > 2 || (argc == 2 && !wal && mode != "--lockfree" && mode != "--bench"))
+	{
+		std::cerr << "Usage: " << argv[0] << " [--lockfree | --wal[=max_delay_us] | --bench]\n";
+		return 1;
+	}
+
+	if (mode == "--bench")
+	{
+		InitializeCriticalSection(&GlobalCriticalSection);
+		std::cout << "Threads             Mode      Ops/sec   p50, us    p99, us  p99.9, us Consistent\n";
+		for (int threadsCount : BENCH_THREADS)
+		{
+			RunBenchmark(threadsCount, BenchMode::Mutex);
+			RunBenchmark(threadsCount, BenchMode::CriticalSection);
+			RunBenchmark(threadsCount, BenchMode::LockFree);
+			RunBenchmark(threadsCount, BenchMode::Wal);
+		}
+		DeleteCriticalSection(&GlobalCriticalSection);
+		return 0;
+	}
+
+	std::unique_ptr<Account> account;
+	std::unique_ptr<BalanceSnapshotter> snapshotter;
+	if (mode == "--lockfree")
+	{
+		account = std::make_unique<Account>(ACCOUNT_NAME);
+		snapshotter = std::make_unique<BalanceSnapshotter>(*account, "balance.txt");
+	}
+
+	// Баланс не обнуляется, а восстанавливается из контрольной точки и журнала
+	std::unique_ptr<DurableAccount> durable;
+	if (wal)
+	{
+		try
+		{
+			durable = std::make_unique<DurableAccount>("balance.txt", WAL_FILE, maxDelay);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << "\n";
+			return 1;
+		}
+	}
+
+	auto* handles = new HANDLE[THREADS_COUNT];
+	auto** data = new threadData*[THREADS_COUNT];
 
 	// GlobalMutex = CreateMutex(nullptr, false, MUTEX_NAME);
 	InitializeCriticalSection(&GlobalCriticalSection);
@@ -117,23 +408,54 @@ int main()
 
 	// WaitForSingleObject(GlobalMutex, INFINITE);
 	// EnterCriticalSection(&GlobalCriticalSection);
-	WriteToFile(0);
-	PrintWithTime(GetCurrentProcessId(), "Balance is set to 0");
+	if (durable)
+	{
+		PrintWithTime(GetCurrentProcessId(), "Balance recovered", static_cast<int>(durable->GetBalance()));
+	}
+	else if (account)
+	{
+		account->SetBalance(0);
+		snapshotter->Save(0);
+		PrintWithTime(GetCurrentProcessId(), "Balance is set to 0");
+	}
+	else
+	{
+		WriteToFile(0);
+		PrintWithTime(GetCurrentProcessId(), "Balance is set to 0");
+	}
 	// ReleaseMutex(GlobalMutex);
 	// LeaveCriticalSection(&GlobalCriticalSection);
 
 	SetProcessAffinityMask(GetCurrentProcess(), 1);
-	for (int i = 0; i < 50; i++)
+	for (int i = 0; i < THREADS_COUNT; i++)
 	{
+		data[i] = new threadData{ i % 2 == 0 ? 230 : 1000, account.get(), durable.get(), {} };
 		handles[i] = i % 2 == 0
-			? CreateThread(nullptr, 0, &DoDeposit, new threadData{ 230 }, CREATE_SUSPENDED, nullptr)
-			: CreateThread(nullptr, 0, &DoWithdraw, new threadData{ 1000 }, CREATE_SUSPENDED, nullptr);
+			? CreateThread(nullptr, 0, &DoDeposit, data[i], CREATE_SUSPENDED, nullptr)
+			: CreateThread(nullptr, 0, &DoWithdraw, data[i], CREATE_SUSPENDED, nullptr);
 		ResumeThread(handles[i]);
 	}
 
-	WaitForMultipleObjects(50, handles, true, INFINITE);
+	WaitForMultipleObjects(THREADS_COUNT, handles, true, INFINITE);
+	if (snapshotter)
+	{
+		snapshotter->Stop();
+	}
+	if (durable)
+	{
+		PrintWithTime(GetCurrentProcessId(), std::format("Durable operations: {}, syncs: {}",
+			durable->GetLog().GetCommits(), durable->GetLog().GetSyncs()));
+		durable->Close();
+	}
 	PrintWithTime(GetCurrentProcessId(), "Final Balance", GetBalance());
 
+	LatencyHistogram deposits, withdrawals;
+	for (int i = 0; i < THREADS_COUNT; i++)
+	{
+		(i % 2 == 0 ? deposits : withdrawals).Merge(data[i]->duration);
+	}
+	PrintLatencies(GetCurrentProcessId(), deposits, withdrawals);
+
 	// CloseHandle(GlobalMutex);
 	DeleteCriticalSection(&GlobalCriticalSection);
 
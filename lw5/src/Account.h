@@ -0,0 +1,151 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <windows.h>
+
+// Баланс в памяти без блокировок: пополнение - атомарное сложение, снятие - цикл CAS,
+// который не даёт уйти в минус. Значение лежит в именованной разделяемой памяти, поэтому
+// процессы, открывшие счёт с одним именем, работают с одним балансом, как раньше с balance.txt
+class Account
+{
+public:
+	static_assert(std::atomic_ref<int64_t>::is_always_lock_free);
+
+	// Без имени счёт виден только этому процессу
+	explicit Account(const char* sharedName = nullptr)
+	{
+		m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(int64_t), sharedName);
+		if (m_mapping == nullptr)
+		{
+			throw std::runtime_error("Cannot create account mapping");
+		}
+		// Новое отображение заполнено нулями, то есть баланс равен 0
+		m_balance = static_cast<int64_t*>(MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(int64_t)));
+		if (m_balance == nullptr)
+		{
+			CloseHandle(m_mapping);
+			throw std::runtime_error("Cannot map account");
+		}
+	}
+
+	~Account()
+	{
+		UnmapViewOfFile(m_balance);
+		CloseHandle(m_mapping);
+	}
+
+	Account(const Account&) = delete;
+	Account& operator=(const Account&) = delete;
+
+	int64_t GetBalance() const { return Balance().load(std::memory_order_acquire); }
+
+	void SetBalance(int64_t balance) { Balance().store(balance, std::memory_order_release); }
+
+	// Возвращает баланс сразу после пополнения
+	int64_t Deposit(int64_t money) { return Balance().fetch_add(money, std::memory_order_acq_rel) + money; }
+
+	// Проверка и списание - одна операция: если между чтением и CAS баланс изменился,
+	// проверка повторяется с новым значением. false - денег не хватает, баланс не изменён
+	bool Withdraw(int64_t money, int64_t& balanceAfter)
+	{
+		auto balance = Balance();
+		int64_t current = balance.load(std::memory_order_relaxed);
+		do
+		{
+			if (current < money)
+			{
+				balanceAfter = current;
+				return false;
+			}
+		} while (!balance.compare_exchange_weak(current, current - money, std::memory_order_acq_rel, std::memory_order_relaxed));
+		balanceAfter = current - money;
+		return true;
+	}
+
+private:
+	std::atomic_ref<int64_t> Balance() const { return std::atomic_ref<int64_t>(*m_balance); }
+
+	HANDLE m_mapping = nullptr;
+	int64_t* m_balance = nullptr;
+};
+
+// Сохраняет баланс в файл раз в интервал, если он изменился, и при остановке. Файл пишется
+// во временный и подменяется целиком, так что читатель не увидит недописанное число
+class BalanceSnapshotter
+{
+public:
+	static constexpr DWORD DEFAULT_INTERVAL_MS = 100;
+
+	BalanceSnapshotter(const Account& account, std::string filename, DWORD intervalMs = DEFAULT_INTERVAL_MS)
+		: m_account(account)
+		, m_filename(std::move(filename))
+		, m_tempFilename(m_filename + "." + std::to_string(GetCurrentProcessId()) + ".tmp")
+		, m_intervalMs(intervalMs)
+	{
+		m_stopEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+		m_thread = CreateThread(nullptr, 0, SnapshotFunction, this, 0, nullptr);
+	}
+
+	~BalanceSnapshotter()
+	{
+		Stop();
+		CloseHandle(m_stopEvent);
+	}
+
+	BalanceSnapshotter(const BalanceSnapshotter&) = delete;
+	BalanceSnapshotter& operator=(const BalanceSnapshotter&) = delete;
+
+	// Останавливает фоновый поток и записывает последний баланс, повторный вызов ничего не делает
+	void Stop()
+	{
+		if (m_thread == nullptr)
+		{
+			return;
+		}
+		SetEvent(m_stopEvent);
+		WaitForSingleObject(m_thread, INFINITE);
+		CloseHandle(m_thread);
+		m_thread = nullptr;
+		Save(m_account.GetBalance());
+	}
+
+	// Записывает баланс сейчас, из любого потока
+	void Save(int64_t balance)
+	{
+		std::lock_guard lock(m_mutex);
+		{
+			std::ofstream file(m_tempFilename, std::ios_base::trunc);
+			file << balance << std::endl;
+		}
+		MoveFileExA(m_tempFilename.c_str(), m_filename.c_str(), MOVEFILE_REPLACE_EXISTING);
+		m_saved = balance;
+	}
+
+private:
+	static DWORD WINAPI SnapshotFunction(LPVOID lpParam)
+	{
+		auto* snapshotter = static_cast<BalanceSnapshotter*>(lpParam);
+		while (WaitForSingleObject(snapshotter->m_stopEvent, snapshotter->m_intervalMs) == WAIT_TIMEOUT)
+		{
+			int64_t balance = snapshotter->m_account.GetBalance();
+			if (balance != snapshotter->m_saved.load())
+			{
+				snapshotter->Save(balance);
+			}
+		}
+		return 0;
+	}
+
+	const Account& m_account;
+	std::string m_filename;
+	std::string m_tempFilename;
+	DWORD m_intervalMs;
+	std::mutex m_mutex;
+	std::atomic<int64_t> m_saved{ -1 };
+	HANDLE m_stopEvent = nullptr;
+	HANDLE m_thread = nullptr;
+};
@@ -0,0 +1,375 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <windows.h>
+
+// Запись журнала - изменение баланса одной успешной операцией
+struct WalRecord
+{
+	uint64_t lsn;
+	int64_t amount;
+	uint32_t checksum;
+	uint32_t reserved;
+};
+
+static_assert(sizeof(WalRecord) == 24);
+
+// FNV-1a по lsn и amount: недописанная при сбое запись не пройдёт проверку
+inline uint32_t WalChecksum(const WalRecord& record)
+{
+	uint32_t hash = 2166136261u;
+	const auto* bytes = reinterpret_cast<const uint8_t*>(&record);
+	for (size_t i = 0; i < offsetof(WalRecord, checksum); ++i)
+	{
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	return hash;
+}
+
+// Журнал упреждающей записи с групповой фиксацией. Append только ставит запись в очередь,
+// фоновый поток пишет накопившиеся записи одним WriteFile и одним FlushFileBuffers (аналог
+// fdatasync), после чего будит всех, кто ждёт в WaitDurable. Пока идёт сброс, следующая
+// группа копится сама; maxDelay дополнительно придерживает сброс, чтобы группы были крупнее
+class WriteAheadLog
+{
+public:
+	static constexpr std::chrono::microseconds DEFAULT_MAX_DELAY{ 0 };
+	static constexpr size_t MAX_BATCH_RECORDS = 4096;
+
+	// Записи с LSN не больше afterLsn уже учтены в контрольной точке. Хвост журнала после первой
+	// повреждённой записи отрезается
+	WriteAheadLog(const std::string& filename, uint64_t afterLsn, std::chrono::microseconds maxDelay = DEFAULT_MAX_DELAY)
+		: m_maxDelay(maxDelay)
+	{
+		m_file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+			OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_file == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error("Cannot open write-ahead log");
+		}
+		Recover(afterLsn);
+		m_flusher = CreateThread(nullptr, 0, FlushFunction, this, 0, nullptr);
+	}
+
+	~WriteAheadLog()
+	{
+		Close();
+	}
+
+	WriteAheadLog(const WriteAheadLog&) = delete;
+	WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+	// Сумма изменений после afterLsn, найденных при открытии
+	int64_t GetRecoveredAmount() const { return m_recoveredAmount; }
+	uint64_t GetRecoveredRecords() const { return m_recoveredRecords; }
+
+	uint64_t GetLastLsn()
+	{
+		std::lock_guard lock(m_mutex);
+		return m_nextLsn - 1;
+	}
+
+	// Порядок LSN - порядок вызовов, на диск записи попадают тоже по порядку
+	uint64_t Append(int64_t amount)
+	{
+		std::lock_guard lock(m_mutex);
+		WalRecord record{ m_nextLsn++, amount, 0, 0 };
+		record.checksum = WalChecksum(record);
+		m_pending.push_back(record);
+		m_pendingChanged.notify_one();
+		return record.lsn;
+	}
+
+	// Возвращает, когда запись lsn и все предыдущие на диске
+	void WaitDurable(uint64_t lsn)
+	{
+		std::unique_lock lock(m_mutex);
+		m_durableChanged.wait(lock, [&] { return m_durableLsn >= lsn || m_failed; });
+		if (m_durableLsn < lsn)
+		{
+			throw std::runtime_error("Cannot write write-ahead log");
+		}
+	}
+
+	// Очищает журнал после записи контрольной точки. Вызывающий не даёт никому вызывать
+	// Append, пока очистка не закончится
+	void Truncate()
+	{
+		std::unique_lock lock(m_mutex);
+		m_durableChanged.wait(lock, [&] { return m_durableLsn == m_nextLsn - 1 || m_failed; });
+		LARGE_INTEGER start{};
+		if (m_failed || !SetFilePointerEx(m_file, start, nullptr, FILE_BEGIN) || !SetEndOfFile(m_file) || !FlushFileBuffers(m_file))
+		{
+			throw std::runtime_error("Cannot truncate write-ahead log");
+		}
+	}
+
+	// Дописывает очередь и закрывает файл, повторный вызов ничего не делает
+	void Close()
+	{
+		if (m_flusher == nullptr)
+		{
+			return;
+		}
+		{
+			std::lock_guard lock(m_mutex);
+			m_stopping = true;
+			m_pendingChanged.notify_one();
+		}
+		WaitForSingleObject(m_flusher, INFINITE);
+		CloseHandle(m_flusher);
+		m_flusher = nullptr;
+		CloseHandle(m_file);
+	}
+
+	// Число сброшенных на диск записей и вызовов FlushFileBuffers для них
+	uint64_t GetCommits()
+	{
+		std::lock_guard lock(m_mutex);
+		return m_commits;
+	}
+
+	uint64_t GetSyncs()
+	{
+		std::lock_guard lock(m_mutex);
+		return m_syncs;
+	}
+
+private:
+	void Recover(uint64_t afterLsn)
+	{
+		std::vector<WalRecord> records(MAX_BATCH_RECORDS);
+		LARGE_INTEGER validEnd{};
+		uint64_t lastLsn = afterLsn;
+		uint64_t previousLsn = 0;
+		DWORD read = 0;
+		bool valid = true;
+		while (valid && ReadFile(m_file, records.data(), static_cast<DWORD>(records.size() * sizeof(WalRecord)), &read, nullptr) && read > 0)
+		{
+			for (size_t i = 0; i < read / sizeof(WalRecord); ++i)
+			{
+				const WalRecord& record = records[i];
+				// LSN в журнале идут подряд, первая запись может продолжать любую контрольную точку
+				if (record.checksum != WalChecksum(record) || (previousLsn > 0 && record.lsn != previousLsn + 1))
+				{
+					valid = false;
+					break;
+				}
+				if (record.lsn > afterLsn)
+				{
+					m_recoveredAmount += record.amount;
+					++m_recoveredRecords;
+				}
+				previousLsn = record.lsn;
+				lastLsn = std::max(lastLsn, record.lsn);
+				validEnd.QuadPart += sizeof(WalRecord);
+			}
+			valid = valid && read % sizeof(WalRecord) == 0;
+		}
+
+		if (!SetFilePointerEx(m_file, validEnd, nullptr, FILE_BEGIN) || !SetEndOfFile(m_file))
+		{
+			throw std::runtime_error("Cannot recover write-ahead log");
+		}
+		m_nextLsn = lastLsn + 1;
+		m_durableLsn = lastLsn;
+	}
+
+	static DWORD WINAPI FlushFunction(LPVOID lpParam)
+	{
+		auto* log = static_cast<WriteAheadLog*>(lpParam);
+		std::vector<WalRecord> batch;
+		std::unique_lock lock(log->m_mutex);
+		while (true)
+		{
+			log->m_pendingChanged.wait(lock, [&] { return !log->m_pending.empty() || log->m_stopping; });
+			if (log->m_pending.empty())
+			{
+				return 0;
+			}
+			if (log->m_maxDelay.count() > 0)
+			{
+				log->m_pendingChanged.wait_for(lock, log->m_maxDelay,
+					[&] { return log->m_pending.size() >= MAX_BATCH_RECORDS || log->m_stopping; });
+			}
+			batch.swap(log->m_pending);
+
+			lock.unlock();
+			DWORD written = 0;
+			DWORD size = static_cast<DWORD>(batch.size() * sizeof(WalRecord));
+			bool ok = WriteFile(log->m_file, batch.data(), size, &written, nullptr) && written == size && FlushFileBuffers(log->m_file);
+			lock.lock();
+
+			if (ok)
+			{
+				log->m_durableLsn = batch.back().lsn;
+				log->m_commits += batch.size();
+				++log->m_syncs;
+			}
+			else
+			{
+				log->m_failed = true;
+			}
+			batch.clear();
+			log->m_durableChanged.notify_all();
+		}
+	}
+
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	std::chrono::microseconds m_maxDelay;
+	int64_t m_recoveredAmount = 0;
+	uint64_t m_recoveredRecords = 0;
+
+	std::mutex m_mutex;
+	std::condition_variable m_pendingChanged;
+	std::condition_variable m_durableChanged;
+	std::vector<WalRecord> m_pending;
+	uint64_t m_nextLsn = 1;
+	uint64_t m_durableLsn = 0;
+	uint64_t m_commits = 0;
+	uint64_t m_syncs = 0;
+	bool m_failed = false;
+	bool m_stopping = false;
+	HANDLE m_flusher = nullptr;
+};
+
+// Баланс, каждое изменение которого на диске до возврата из Deposit и Withdraw. Контрольная
+// точка - файл "<баланс> <LSN>", при открытии к ней добавляются записи журнала после LSN,
+// после чего пишется новая контрольная точка и журнал очищается.
+// Проверка баланса и получение LSN идут под одним мьютексом, поэтому любой сброшенный на диск
+// префикс журнала - допустимая история без ухода в минус. Ожидание диска - уже вне мьютекса
+class DurableAccount
+{
+public:
+	DurableAccount(std::string checkpointFile, const std::string& walFile,
+		std::chrono::microseconds maxDelay = WriteAheadLog::DEFAULT_MAX_DELAY)
+		: m_checkpointFile(std::move(checkpointFile))
+	{
+		uint64_t checkpointLsn = 0;
+		std::ifstream checkpoint(m_checkpointFile);
+		checkpoint >> m_balance >> checkpointLsn;
+
+		m_wal = std::make_unique<WriteAheadLog>(walFile, checkpointLsn, maxDelay);
+		m_balance += m_wal->GetRecoveredAmount();
+		Checkpoint();
+	}
+
+	// Ошибку диска при закрытии уже некому сообщить, журнал восстановится при следующем открытии
+	~DurableAccount()
+	{
+		try
+		{
+			Close();
+		}
+		catch (const std::exception&)
+		{
+		}
+	}
+
+	DurableAccount(const DurableAccount&) = delete;
+	DurableAccount& operator=(const DurableAccount&) = delete;
+
+	int64_t GetBalance()
+	{
+		std::lock_guard lock(m_mutex);
+		return m_balance;
+	}
+
+	WriteAheadLog& GetLog() { return *m_wal; }
+
+	// Возвращает баланс сразу после пополнения
+	int64_t Deposit(int64_t money)
+	{
+		int64_t balance;
+		uint64_t lsn;
+		{
+			std::lock_guard lock(m_mutex);
+			m_balance += money;
+			balance = m_balance;
+			lsn = m_wal->Append(money);
+		}
+		m_wal->WaitDurable(lsn);
+		return balance;
+	}
+
+	// false - денег не хватает. Отказ тоже ждёт диска, чтобы не опираться на баланс,
+	// который после сбоя может не восстановиться
+	bool Withdraw(int64_t money, int64_t& balanceAfter)
+	{
+		bool withdrawn = false;
+		uint64_t lsn;
+		{
+			std::lock_guard lock(m_mutex);
+			if (m_balance >= money)
+			{
+				m_balance -= money;
+				lsn = m_wal->Append(-money);
+				withdrawn = true;
+			}
+			else
+			{
+				lsn = m_wal->GetLastLsn();
+			}
+			balanceAfter = m_balance;
+		}
+		m_wal->WaitDurable(lsn);
+		return withdrawn;
+	}
+
+	// Пишет контрольную точку и очищает журнал. Операции на это время ждут
+	void Checkpoint()
+	{
+		std::lock_guard lock(m_mutex);
+		uint64_t lsn = m_wal->GetLastLsn();
+		m_wal->WaitDurable(lsn);
+		WriteCheckpoint(std::to_string(m_balance) + " " + std::to_string(lsn) + "\n");
+		m_wal->Truncate();
+	}
+
+	// Контрольная точка и закрытие журнала, повторный вызов ничего не делает
+	void Close()
+	{
+		if (m_closed)
+		{
+			return;
+		}
+		Checkpoint();
+		m_wal->Close();
+		m_closed = true;
+	}
+
+private:
+	// Временный файл сбрасывается на диск до подмены, иначе после сбоя можно получить
+	// пустую контрольную точку при уже очищенном журнале
+	void WriteCheckpoint(const std::string& text)
+	{
+		std::string tempFile = m_checkpointFile + ".tmp";
+		HANDLE file = CreateFileA(tempFile.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error("Cannot create checkpoint");
+		}
+		DWORD written = 0;
+		bool ok = WriteFile(file, text.data(), static_cast<DWORD>(text.size()), &written, nullptr) && FlushFileBuffers(file);
+		CloseHandle(file);
+		if (!ok || !MoveFileExA(tempFile.c_str(), m_checkpointFile.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+		{
+			throw std::runtime_error("Cannot write checkpoint");
+		}
+	}
+
+	std::string m_checkpointFile;
+	std::unique_ptr<WriteAheadLog> m_wal;
+	std::mutex m_mutex;
+	int64_t m_balance = 0;
+	bool m_closed = false;
+};
@@ -1,6 +1,6 @@
 @echo off
 echo Starting two processes...
 echo ================================
-start "First" /D "out/build/x64-Release" lw5.exe
-start "Second" /D "out/build/x64-Release" lw5.exe
+start "First" /D "out/build/x64-Release" lw5.exe %*
+start "Second" /D "out/build/x64-Release" lw5.exe %*
 exit
\ No newline at end of file